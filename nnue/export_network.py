@@ -0,0 +1,72 @@
+import os
+import struct
+import sys
+import chess
+import torch
+from omegaconf import OmegaConf
+from model import NNUE, load_checkpoint, input_size, hl_size, num_output_buckets, num_king_buckets
+from position import board_to_tensor
+
+network_file_path = "/home/seb/git/Stalemater2000/weights/default.nnue"
+model_path = "/home/seb/git/Stalemater2000/nnue/output/exp_2025-03-21_15-28-50/nnue_0001-9.pt"
+
+if len(sys.argv) > 1:
+    model_path = sys.argv[1]
+if len(sys.argv) > 2:
+    network_file_path = sys.argv[2]
+# the float evaluations of the trained model for these positions are written next to the network,
+# tests/test_engine.py compares the quantized engine against them
+reference_fens = list(OmegaConf.load(os.path.join(os.path.dirname(__file__), "../tests/test_config.yml")).test_positions.positions)
+if len(sys.argv) > 3:
+    with open(sys.argv[3]) as f:
+        reference_fens = [line.strip() for line in f if line.strip()]
+
+# must match src/nnue.h
+NNUE_FILE_MAGIC = b"STLMNNUE"
+NNUE_FILE_VERSION = 2
+HEADER_SIZE = 64
+QA = 255
+QB = 256
+SCRELU_SHIFT = 8
+OUTPUT_SCALE = (QA * QA * QB) >> SCRELU_SHIFT
+
+nnue = NNUE()
+load_checkpoint(model_path, nnue)
+
+def quantize(tensor, scale, dtype):
+    """Rounds to fixed point and saturates to the range of dtype."""
+    info = torch.iinfo(dtype)
+    return torch.round(tensor.detach() * scale).clamp(info.min, info.max).to(dtype)
+
+def to_bytes(tensor):
+    # every section is a multiple of 64 bytes, so the file matches the aligned struct layout
+    data = tensor.contiguous().numpy().tobytes()
+    assert len(data) % 64 == 0
+    return data
+
+header = struct.pack("<8sIIIIIiii", NNUE_FILE_MAGIC, NNUE_FILE_VERSION,
+                     input_size, hl_size, num_output_buckets, num_king_buckets, QA, QB, SCRELU_SHIFT)
+
+with open(network_file_path, "wb") as f:
+    f.write(header.ljust(HEADER_SIZE, b"\0"))
+    print("Exporting accumulation_layer.weight")
+    f.write(to_bytes(quantize(nnue.accumulation_layer.weight.T, QA, torch.int16)))
+    print("Exporting accumulation_layer.bias")
+    f.write(to_bytes(quantize(nnue.accumulation_layer.bias, QA, torch.int16)))
+    print("Exporting output_layer.weight")
+    f.write(to_bytes(quantize(nnue.output_layer.weight, QB, torch.int16)))
+    print("Exporting output_layer.bias")
+    output_bias = quantize(nnue.output_layer.bias, OUTPUT_SCALE, torch.int32)
+    f.write(output_bias.numpy().tobytes().ljust(64, b"\0"))
+
+print(f"Network file written to {network_file_path}")
+
+# relative to white, like the output of evalbatch
+reference_path = network_file_path + ".float"
+with torch.no_grad(), open(reference_path, "w") as f:
+    for fen in reference_fens:
+        inputs = board_to_tensor(chess.Board(fen)).to(dtype=torch.float32).unsqueeze(0)
+        black_to_move = torch.tensor([[fen.split(" ")[1] == "b"]])
+        f.write(f"{fen}: {nnue(inputs, black_to_move).item()}\n")
+
+print(f"Float evaluations of {len(reference_fens)} positions written to {reference_path}")
@@ -23,12 +23,37 @@ class LeakySCReLU(nn.Module):
 
         return y
 
-input_size = 768
+num_features = 768
+num_king_buckets = 4
+input_size = num_features * num_king_buckets
 hl_size = 1024
 # output_scale = 400
 
 num_output_buckets = 8
 
+# must match KING_BUCKETS in src/nnue.h, indexed by the own king square seen from the perspective
+king_buckets = torch.tensor([
+    0, 0, 0, 0, 1, 1, 1, 1,
+    0, 0, 0, 0, 1, 1, 1, 1,
+    2, 2, 2, 2, 3, 3, 3, 3,
+    2, 2, 2, 2, 3, 3, 3, 3,
+    2, 2, 2, 2, 3, 3, 3, 3,
+    2, 2, 2, 2, 3, 3, 3, 3,
+    2, 2, 2, 2, 3, 3, 3, 3,
+    2, 2, 2, 2, 3, 3, 3, 3,
+])
+
+def get_king_bucketed_input(x: torch.tensor):
+    """
+    Expands the 768 features of one perspective into the slot of its king bucket.
+    The own king is always on plane 5, because black's view is color swapped.
+    """
+    own_king = x.reshape(-1, 12, 64)[:, 5, :]
+    king_square = own_king.argmax(dim=1)
+    bucket = king_buckets.to(x.device)[king_square]
+    bucket_mask = nn.functional.one_hot(bucket, num_king_buckets).to(dtype=x.dtype)
+    return (bucket_mask.unsqueeze(2) * x.unsqueeze(1)).reshape(-1, input_size)
+
 def get_occupancy(x: torch.tensor):
     occupancy, _ = x.reshape(-1, 12, 8, 8).max(dim=1)
     return occupancy
@@ -61,10 +86,10 @@ class NNUE(nn.Module):
         # flip
         x_grouped = x.reshape(-1, 2, 6, 8, 8)
         x_flipped = torch.flip(x_grouped, [1, 3])
-        x_flipped = x_flipped.reshape(-1, input_size)
+        x_flipped = x_flipped.reshape(-1, num_features)
 
-        acc_white = self.accumulation_layer(x)
-        acc_black = self.accumulation_layer(x_flipped)
+        acc_white = self.accumulation_layer(get_king_bucketed_input(x))
+        acc_black = self.accumulation_layer(get_king_bucketed_input(x_flipped))
 
         acc_normal = torch.cat([ acc_white, acc_black ], dim=1)
         acc_flipped = torch.cat([acc_black, acc_white], dim=1)
@@ -0,0 +1,106 @@
+#include "attacks.h"
+
+#include <cstdint>
+
+SliderMagic ROOK_MAGICS[64];
+SliderMagic BISHOP_MAGICS[64];
+
+// with fancy magics every square gets exactly 2^bits(mask) entries, the same layout serves pext
+static U64 ROOK_ATTACK_TABLE[0x19000];
+static U64 BISHOP_ATTACK_TABLE[0x1480];
+
+#ifndef USE_PEXT
+// https://www.chessprogramming.org/Looking_for_Magics
+// xorshift64*, seeded per rank with values which find all magics after few tries
+class MagicRandom {
+   public:
+    explicit MagicRandom(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 2685821657736338717ULL;
+    }
+
+    // magics with few set bits are found much faster
+    uint64_t sparse() {
+        return next() & next() & next();
+    }
+
+   private:
+    uint64_t state;
+};
+
+constexpr uint64_t MAGIC_SEEDS[8] = {728, 10316, 55013, 32803, 12281, 15100, 16645, 255};
+
+// try random magics until one maps every subset without a destructive collision
+static void findMagic(SliderMagic& m, int square, const U64* occupancies, const U64* references, int size) {
+    static int epoch[4096] = {};
+    static int attempt = 0;
+
+    MagicRandom random(MAGIC_SEEDS[square / 8]);
+    for (int i = 0; i < size;) {
+        do {
+            m.magic = random.sparse();
+        } while (countBits((m.magic * m.mask) >> 56) < 6);
+
+        attempt++;
+        for (i = 0; i < size; i++) {
+            U64 index = ((occupancies[i] & m.mask) * m.magic) >> m.shift;
+            if (epoch[index] < attempt) {
+                epoch[index] = attempt;
+                m.attacks[index] = references[i];
+            } else if (m.attacks[index] != references[i]) {
+                break;
+            }
+        }
+    }
+}
+#endif
+
+static void initSlider(SliderMagic* magics, U64* table, const int (*directions)[2]) {
+    U64 occupancies[4096], references[4096];
+    U64* next = table;
+
+    for (int square = 0; square < 64; square++) {
+        // the last square of a ray is attacked whether or not it is occupied
+        U64 edges = ((RANK_1 | RANK_8) & ~RANK_MASKS[square / 8]) | ((FILE_A | FILE_H) & ~FILE_MASKS[square % 8]);
+        SliderMagic& m = magics[square];
+        m.mask = rayAttacks(square, 0, directions) & ~edges;
+        m.shift = 64 - countBits(m.mask);
+        m.attacks = next;
+
+        // every subset of the mask (carry rippler)
+        int size = 0;
+        U64 subset = 0;
+        do {
+            occupancies[size] = subset;
+            references[size] = rayAttacks(square, subset, directions);
+            size++;
+            subset = (subset - m.mask) & m.mask;
+        } while (subset);
+        next += size;
+
+#ifdef USE_PEXT
+        for (int i = 0; i < size; i++) {
+            m.attacks[pext(occupancies[i], m.mask)] = references[i];
+        }
+#else
+        findMagic(m, square, occupancies, references, size);
+#endif
+    }
+}
+
+void InitAttacks() {
+    initSlider(ROOK_MAGICS, ROOK_ATTACK_TABLE, ROOK_DIRECTIONS);
+    initSlider(BISHOP_MAGICS, BISHOP_ATTACK_TABLE, BISHOP_DIRECTIONS);
+}
+
+const char* sliderAttacksName() {
+#ifdef USE_PEXT
+    return "pext";
+#else
+    return "magic";
+#endif
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <array>
+
+#include "bitmath.h"
+#include "labels.h"
+
+// steps as {file, rank} offsets
+constexpr int KNIGHT_STEPS[8][2] = {{1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
+constexpr int KING_STEPS[8][2] = {{1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}, {0, -1}, {1, -1}};
+constexpr int ROOK_DIRECTIONS[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+constexpr int BISHOP_DIRECTIONS[4][2] = {{1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+
+constexpr bool onBoard(int file, int rank) {
+    return file >= 0 && file < 8 && rank >= 0 && rank < 8;
+}
+
+// squares reached by a single step in each direction, steps leaving the board are dropped
+constexpr U64 stepAttacks(int square, const int (*steps)[2], int numSteps) {
+    U64 attacks = 0;
+    for (int s = 0; s < numSteps; s++) {
+        int file = square % 8 + steps[s][0];
+        int rank = square / 8 + steps[s][1];
+        if (onBoard(file, rank)) {
+            attacks |= 1ULL << (rank * 8 + file);
+        }
+    }
+    return attacks;
+}
+
+// walks each ray until and including the first occupied square, slow but usable at compile time
+constexpr U64 rayAttacks(int square, U64 occupied, const int (*directions)[2]) {
+    U64 attacks = 0;
+    for (int d = 0; d < 4; d++) {
+        int file = square % 8 + directions[d][0];
+        int rank = square / 8 + directions[d][1];
+        while (onBoard(file, rank)) {
+            U64 hot = 1ULL << (rank * 8 + file);
+            attacks |= hot;
+            if (occupied & hot) {
+                break;
+            }
+            file += directions[d][0];
+            rank += directions[d][1];
+        }
+    }
+    return attacks;
+}
+
+constexpr std::array<U64, 64> makeStepTable(const int (*steps)[2], int numSteps) {
+    std::array<U64, 64> table{};
+    for (int square = 0; square < 64; square++) {
+        table[square] = stepAttacks(square, steps, numSteps);
+    }
+    return table;
+}
+
+constexpr std::array<std::array<U64, 64>, 2> makePawnTable() {
+    constexpr int WHITE_CAPTURES[2][2] = {{-1, 1}, {1, 1}};
+    constexpr int BLACK_CAPTURES[2][2] = {{-1, -1}, {1, -1}};
+    std::array<std::array<U64, 64>, 2> table{};
+    for (int square = 0; square < 64; square++) {
+        table[(int)Side::White][square] = stepAttacks(square, WHITE_CAPTURES, 2);
+        table[(int)Side::Black][square] = stepAttacks(square, BLACK_CAPTURES, 2);
+    }
+    return table;
+}
+
+// between: squares strictly between two squares on a common rank, file or diagonal
+// line: the whole line through both squares, including them
+// both are empty when the squares are not aligned
+constexpr std::array<std::array<U64, 64>, 64> makeRayTable(bool between) {
+    std::array<std::array<U64, 64>, 64> table{};
+    for (int a = 0; a < 64; a++) {
+        for (int b = 0; b < 64; b++) {
+            if (a == b) {
+                continue;
+            }
+            U64 bitA = 1ULL << a, bitB = 1ULL << b;
+            for (const auto* directions : {ROOK_DIRECTIONS, BISHOP_DIRECTIONS}) {
+                if (!(rayAttacks(a, 0, directions) & bitB)) {
+                    continue;
+                }
+                table[a][b] = between ? rayAttacks(a, bitB, directions) & rayAttacks(b, bitA, directions)
+                                      : (rayAttacks(a, 0, directions) & rayAttacks(b, 0, directions)) | bitA | bitB;
+            }
+        }
+    }
+    return table;
+}
+
+constexpr std::array<U64, 64> KNIGHT_ATTACKS = makeStepTable(KNIGHT_STEPS, 8);
+constexpr std::array<U64, 64> KING_ATTACKS = makeStepTable(KING_STEPS, 8);
+// indexed by the side of the pawn, the squares it captures on
+constexpr std::array<std::array<U64, 64>, 2> PAWN_ATTACKS = makePawnTable();
+constexpr std::array<std::array<U64, 64>, 64> BETWEEN = makeRayTable(true);
+constexpr std::array<std::array<U64, 64>, 64> LINE = makeRayTable(false);
+
+// https://www.chessprogramming.org/Magic_Bitboards
+// attacks of a slider only depend on the few relevant squares of its rays, which are mapped to a dense
+// index either by a multiplication with a magic number or by the BMI2 pext instruction
+
+struct SliderMagic {
+    U64 mask;    // relevant occupancy, the rays without the last square towards the edge
+    U64 magic;
+    U64* attacks;
+    int shift;
+};
+
+// pext is only used when the build targets bmi2, e.g. ARCH=native or ARCH=x86-64-v3. Zen 1 and 2 run it in
+// microcode, slower than the multiplication of the magics
+#if defined(__BMI2__) && !defined(__znver1__) && !defined(__znver2__)
+#define USE_PEXT
+#endif
+
+extern SliderMagic ROOK_MAGICS[64];
+extern SliderMagic BISHOP_MAGICS[64];
+
+void InitAttacks();
+const char* sliderAttacksName();
+
+inline U64 sliderAttacks(const SliderMagic& m, U64 occupied) {
+#ifdef USE_PEXT
+    return m.attacks[pext(occupied, m.mask)];
+#else
+    return m.attacks[((occupied & m.mask) * m.magic) >> m.shift];
+#endif
+}
+
+// horizontal and vertical attacks, blocked by and including the first piece of occupied on each ray
+inline U64 rookAttacks(int square, U64 occupied) {
+    return sliderAttacks(ROOK_MAGICS[square], occupied);
+}
+
+// diagonal and antidiagonal attacks, blocked by and including the first piece of occupied on each ray
+inline U64 bishopAttacks(int square, U64 occupied) {
+    return sliderAttacks(BISHOP_MAGICS[square], occupied);
+}
@@ -1,30 +1,28 @@
 #pragma once
-#include "labels.h"
-
-// ????????????
-// https://www.techiedelight.com/reverse-bits-integer-using-lookup-table/
-// macros to generate the lookup table (at compile-time)
-#define R2(n) n,     n + 2*64,     n + 1*64,     n + 3*64
-#define R4(n) R2(n), R2(n + 2*16), R2(n + 1*16), R2(n + 3*16)
-#define R6(n) R4(n), R4(n + 2*4 ), R4(n + 1*4 ), R4(n + 3*4 )
-#define REVERSE_BITS R6(0), R6(2), R6(1), R6(3)
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
-// lookup-table to store the reverse of each index of the table
-// The macro REVERSE_BITS generates the table
-constexpr unsigned int REVERSED_BYTES[256] = { REVERSE_BITS };
-
-U64 reverse(U64 n);
+#include "labels.h"
 
-constexpr unsigned int NUMBER_OF_BITS[256] = {
-	0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,
-	1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,
-	1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,
-	2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,4,5,5,6,5,6,6,7,5,6,6,7,6,7,7,8
-};
+// thin wrappers around the bit instructions, the compiler emits popcnt/tzcnt when the target has them
 
-unsigned int countBits(U64 n);
+inline unsigned int countBits(U64 n) {
+    return __builtin_popcountll(n);
+}
 
-int trailingZeros(U64 x);
+// 64 for an empty board, like tzcnt
+inline int trailingZeros(U64 x) {
+    return x ? __builtin_ctzll(x) : 64;
+}
 
-void popLSB(U64& bb);
+inline void popLSB(U64& bb) {
+    bb &= bb - 1;
+}
 
+// gathers the bits of n selected by mask into the low bits, only available when the build targets bmi2
+#if defined(__BMI2__)
+inline U64 pext(U64 n, U64 mask) {
+    return _pext_u64(n, mask);
+}
+#endif
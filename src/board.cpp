@@ -2,7 +2,9 @@
 
 #include <cassert>
 
+#include "attacks.h"
 #include "bitmath.h"
+#include "eval.h"
 
 void Board::forbidCastling(CastlingTypes castling) {
     assert(0 <= (int)castling && (int)castling < 4);
@@ -35,12 +37,27 @@ U64 Board::getHash() const {
 }
 
 bool Board::hasCheck(CheckFlags checkingSide) const {
-    return (_checks & (int)checkingSide) != 0;
+    bool white = checkingSide == CheckFlags::WhiteInCheck;
+    U64 king = boards[(int)(white ? BitBoards::KW : BitBoards::KB)];
+    if (!king) {
+        return false;
+    }
+    return attackersTo(trailingZeros(king), _occupied) & (white ? _blackPieces : _whitePieces);
 }
 
-bool Board::movePieceOrCapture(BitBoards bb, int from, int to) {
-    useDerivedState();
+bool Board::isInCheck() {
+    usePins();
+    return _checkers != 0;
+}
 
+bool Board::hasNonPawnMaterial(Side side) const {
+    if (side == Side::White) {
+        return boards[(int)BitBoards::RW] | boards[(int)BitBoards::NW] | boards[(int)BitBoards::BW] | boards[(int)BitBoards::QW];
+    }
+    return boards[(int)BitBoards::RB] | boards[(int)BitBoards::NB] | boards[(int)BitBoards::BB] | boards[(int)BitBoards::QB];
+}
+
+bool Board::movePieceOrCapture(BitBoards bb, int from, int to) {
     U64 toMask = 1ULL << to;
     bool isCapture = false;
     // test capture
@@ -71,7 +88,11 @@ bool Board::movePieceOrCapture(BitBoards bb, int from, int to) {
 void Board::placePiece(BitBoards bb, int square) {
     // piece should not exists
     assert(~(boards[(int)bb] & (1ULL << square)));
-    boards[(int)bb] |= 1ULL << square;
+    U64 mask = 1ULL << square;
+    boards[(int)bb] |= mask;
+    ((int)bb < 6 ? _whitePieces : _blackPieces) |= mask;
+    _occupied |= mask;
+    _derivedValid = 0;
     hash ^= ZobristValues[64 * (int)bb + square];
     if (editRecorder) {
         editRecorder->record(BoardEdit(BoardEditType::Add, (int)bb, square));
@@ -81,16 +102,28 @@ void Board::placePiece(BitBoards bb, int square) {
 void Board::removePiece(BitBoards bb, int square) {
     // piece should exist
     assert(boards[(int)bb] & (1ULL << square));
-    boards[(int)bb] &= ~(1ULL << square);
+    U64 mask = 1ULL << square;
+    boards[(int)bb] &= ~mask;
+    ((int)bb < 6 ? _whitePieces : _blackPieces) &= ~mask;
+    _occupied &= ~mask;
+    _derivedValid = 0;
     hash ^= ZobristValues[64 * (int)bb + square];
     if (editRecorder) {
         editRecorder->record(BoardEdit(BoardEditType::Remove, (int)bb, square));
     }
 }
 
+// attack maps only depend on the pieces, but pins and checkers belong to the side to move
 void Board::switchSide() {
     side = (Side)((int)side ^ 1);
     hash ^= ZobristValues[ZOBRIST_BLACK_MOVE];
+    _derivedValid &= ~(int)DerivedState::Pins;
+}
+
+// null move
+void Board::passTurn() {
+    setEnpassantTarget(0);
+    switchSide();
 }
 
 void Board::setEnpassantTarget(U64 newTarget) {
@@ -105,6 +138,31 @@ void Board::setEnpassantTarget(U64 newTarget) {
     }
 }
 
+void Board::saveUndo(BoardUndo& undo) const {
+    undo.enpassantTarget = enpassantTarget;
+    undo.castlingRights = castlingRights;
+    undo.hash = hash;
+    undo.unsafeForWhite = _unsafeForWhite;
+    undo.unsafeForBlack = _unsafeForBlack;
+    undo.checkers = _checkers;
+    undo.pinned = _pinned;
+    undo.checkMask = _checkMask;
+    undo.derivedValid = _derivedValid;
+}
+
+// pieces must already be back in place, only overwrites the remaining state
+void Board::restoreUndo(const BoardUndo& undo) {
+    enpassantTarget = undo.enpassantTarget;
+    castlingRights = undo.castlingRights;
+    hash = undo.hash;
+    _unsafeForWhite = undo.unsafeForWhite;
+    _unsafeForBlack = undo.unsafeForBlack;
+    _checkers = undo.checkers;
+    _pinned = undo.pinned;
+    _checkMask = undo.checkMask;
+    _derivedValid = undo.derivedValid;
+}
+
 void Board::sanityCheck() {
     assert(isLegal());
 
@@ -128,39 +186,88 @@ void Board::sanityCheck() {
 
     assert(countBits(boards[(int)BitBoards::KW]) == 1);
     assert(countBits(boards[(int)BitBoards::KB]) == 1);
+
+    // incrementally updated occupancies
+    assert(_whitePieces == (boards[0] | boards[1] | boards[2] | boards[3] | boards[4] | boards[5]));
+    assert(_blackPieces == (boards[6] | boards[7] | boards[8] | boards[9] | boards[10] | boards[11]));
+    assert(_occupied == (_whitePieces | _blackPieces));
 }
 
-bool Board::isLegal() {
-    useDerivedState();
-    bool whiteCheck = _checks & (char)CheckFlags::WhiteInCheck;
-    bool blackCheck = _checks & (char)CheckFlags::BlackInCheck;
-    if (side == Side::Black && whiteCheck) return false;  // illegal
-    if (side == Side::White && blackCheck) return false;
-    return true;
+bool Board::isLegal() const {
+    return !hasCheck(side == Side::White ? CheckFlags::BlackInCheck : CheckFlags::WhiteInCheck);
 }
 
-void Board::useDerivedState() {
-    if (hash == _lastDerivedHash) {
-        // board has not changed
-        return;
+U64 Board::useUnsafeFor(Side forSide) {
+    DerivedState part = forSide == Side::White ? DerivedState::UnsafeForWhite : DerivedState::UnsafeForBlack;
+    if (!(_derivedValid & (int)part)) {
+        if (forSide == Side::White) {
+            _unsafeForWhite = findUnsafeForWhite();
+        } else {
+            _unsafeForBlack = findUnsafeForBlack();
+        }
+        _derivedValid |= (int)part;
     }
+    return forSide == Side::White ? _unsafeForWhite : _unsafeForBlack;
+}
 
-    _whitePieces = boards[0] | boards[1] | boards[2] | boards[3] | boards[4] | boards[5];
-    _blackPieces = boards[6] | boards[7] | boards[8] | boards[9] | boards[10] | boards[11];
-    _occupied = _whitePieces | _blackPieces;
+void Board::usePins() {
+    if (!(_derivedValid & (int)DerivedState::Pins)) {
+        findPinsAndCheckers();
+        _derivedValid |= (int)DerivedState::Pins;
+    }
+}
 
-    _unsafeForWhite = findUnsafeForWhite();
-    _unsafeForBlack = findUnsafeForBlack();
+void Board::useMoveGenState() {
+    useUnsafeFor(side);
+    usePins();
+}
 
-    _checks = 0;
-    if (boards[(int)BitBoards::KW] & _unsafeForWhite) {
-        _checks |= (int)CheckFlags::WhiteInCheck;
+void Board::findPinsAndCheckers() {
+    bool isWhite = side == Side::White;
+    U64 king = boards[(int)(isWhite ? BitBoards::KW : BitBoards::KB)];
+    _checkers = 0;
+    _pinned = 0;
+    _checkMask = ~0ULL;
+    if (!king) {
+        return;
+    }
+
+    int kingSquare = trailingZeros(king);
+    U64 own = isWhite ? _whitePieces : _blackPieces;
+    U64 enemies = isWhite ? _blackPieces : _whitePieces;
+    int e = isWhite ? 6 : 0;
+    U64 rooks = boards[e + 1] | boards[e + 4];
+    U64 bishops = boards[e + 3] | boards[e + 4];
+
+    _checkers = attackersTo(kingSquare, _occupied) & enemies;
+
+    // enemy sliders which would see the king through own pieces, a single own piece in between is pinned
+    U64 snipers = (rookAttacks(kingSquare, enemies) & rooks) | (bishopAttacks(kingSquare, enemies) & bishops);
+    while (snipers) {
+        int i = trailingZeros(snipers);
+        snipers &= snipers - 1;
+        U64 blockers = BETWEEN[kingSquare][i] & _occupied;
+        if (blockers && !(blockers & (blockers - 1)) && (blockers & own)) {
+            _pinned |= blockers;
+        }
     }
-    if (boards[(int)BitBoards::KB] & _unsafeForBlack) {
-        _checks |= (int)CheckFlags::BlackInCheck;
+
+    if (_checkers & (_checkers - 1)) {
+        _checkMask = 0;  // double check, only the king can move
+    } else if (_checkers) {
+        _checkMask = _checkers | BETWEEN[kingSquare][trailingZeros(_checkers)];
     }
+}
 
-    _lastDerivedHash = hash;
+// en passant removes two pieces from the rank of the king, so instead of pins the position after it is checked
+bool Board::isLegalEnpassant(int from) const {
+    bool isWhite = side == Side::White;
+    int to = trailingZeros(enpassantTarget);
+    int captured = isWhite ? to - 8 : to + 8;
+    U64 occupied = _occupied ^ (1ULL << from) ^ (1ULL << to) ^ (1ULL << captured);
+    U64 enemies = (isWhite ? _blackPieces : _whitePieces) & ~(1ULL << captured);
+    int kingSquare = trailingZeros(boards[(int)(isWhite ? BitBoards::KW : BitBoards::KB)]);
+    return !(attackersTo(kingSquare, occupied) & enemies);
 }
 
 U64 Board::findUnsafeForWhite() const {
@@ -174,7 +281,7 @@ U64 Board::findUnsafeForWhite() const {
     while (bishops) {
         i = trailingZeros(bishops);
         bishops ^= 1ULL << i;  // unset this bit
-        U64 bishopMoves = getDandAntiDMoves(i);
+        U64 bishopMoves = bishopAttacks(i, _occupied);
         unsafe |= bishopMoves;
     }
     // ROOKS
@@ -183,7 +290,7 @@ U64 Board::findUnsafeForWhite() const {
     while (rooks) {
         i = trailingZeros(rooks);
         rooks ^= 1ULL << i;  // unset this bit
-        unsafe |= getHAndVMoves(i);
+        unsafe |= rookAttacks(i, _occupied);
     }
     // QUEENS
     i = 0;
@@ -191,7 +298,7 @@ U64 Board::findUnsafeForWhite() const {
     while (queens) {
         i = trailingZeros(queens);
         queens ^= 1ULL << i;  // unset this bit
-        unsafe |= getHAndVMoves(i) | getDandAntiDMoves(i);
+        unsafe |= rookAttacks(i, _occupied) | bishopAttacks(i, _occupied);
     }
     // HORSES
     i = 0;
@@ -199,13 +306,7 @@ U64 Board::findUnsafeForWhite() const {
     while (horses) {
         i = trailingZeros(horses);
         horses ^= 1ULL << i;  // unset this bit
-        int offset = i - SPAN_HORSE_OFFSET;
-        U64 horseMoves = offset > 0 ? SPAN_HORSE << offset : SPAN_HORSE >> -offset;  // weird stuff happens when shifting by neg number
-        if (i % 8 < 4)
-            horseMoves &= ~FILE_GH;
-        else
-            horseMoves &= ~FILE_AB;
-        unsafe |= horseMoves;
+        unsafe |= KNIGHT_ATTACKS[i];
     }
     // KING
     i = 0;
@@ -213,13 +314,7 @@ U64 Board::findUnsafeForWhite() const {
     if (king) {
         i = trailingZeros(king);
         king ^= 1ULL << i;  // unset this bit
-        int offset = i - SPAN_KING_OFFSET;
-        U64 kingMoves = offset > 0 ? SPAN_KING << offset : SPAN_KING >> -offset;  // weird stuff happens when shifting by neg number
-        if (i % 8 < 4)
-            kingMoves &= ~FILE_H;
-        else
-            kingMoves &= ~FILE_A;
-        unsafe |= kingMoves;
+        unsafe |= KING_ATTACKS[i];
     }
     return unsafe;
 }
@@ -236,7 +331,7 @@ U64 Board::findUnsafeForBlack() const {
     while (bishops) {
         i = trailingZeros(bishops);
         bishops ^= 1ULL << i;  // unset this bit
-        U64 bishopMoves = getDandAntiDMoves(i);
+        U64 bishopMoves = bishopAttacks(i, _occupied);
         unsafe |= bishopMoves;
     }
     // ROOKS
@@ -245,7 +340,7 @@ U64 Board::findUnsafeForBlack() const {
     while (rooks) {
         i = trailingZeros(rooks);
         rooks ^= 1ULL << i;  // unset this bit
-        unsafe |= getHAndVMoves(i);
+        unsafe |= rookAttacks(i, _occupied);
     }
     // QUEENS
     i = 0;
@@ -253,7 +348,7 @@ U64 Board::findUnsafeForBlack() const {
     while (queens) {
         i = trailingZeros(queens);
         queens ^= 1ULL << i;  // unset this bit
-        unsafe |= getHAndVMoves(i) | getDandAntiDMoves(i);
+        unsafe |= rookAttacks(i, _occupied) | bishopAttacks(i, _occupied);
     }
     // HORSES
     i = 0;
@@ -261,13 +356,7 @@ U64 Board::findUnsafeForBlack() const {
     while (horses) {
         i = trailingZeros(horses);
         horses ^= 1ULL << i;  // unset this bit
-        int offset = i - SPAN_HORSE_OFFSET;
-        U64 horseMoves = offset > 0 ? SPAN_HORSE << offset : SPAN_HORSE >> -offset;  // weird stuff happens when shifting by neg number
-        if (i % 8 < 4)
-            horseMoves &= ~FILE_GH;
-        else
-            horseMoves &= ~FILE_AB;
-        unsafe |= horseMoves;
+        unsafe |= KNIGHT_ATTACKS[i];
     }
     // KING
     i = 0;
@@ -275,40 +364,152 @@ U64 Board::findUnsafeForBlack() const {
     if (king) {
         i = trailingZeros(king);
         king ^= 1ULL << i;  // unset this bit
-        int offset = i - SPAN_KING_OFFSET;
-        U64 kingMoves = offset > 0 ? SPAN_KING << offset : SPAN_KING >> -offset;  // weird stuff happens when shifting by neg number
-        if (i % 8 < 4)
-            kingMoves &= ~FILE_H;
-        else
-            kingMoves &= ~FILE_A;
-        unsafe |= kingMoves;
+        unsafe |= KING_ATTACKS[i];
     }
     return unsafe;
 }
 
-U64 Board::getOccupied() {
-    useDerivedState();
+// index into PIECE_VALUES of the piece a pawn promotes to
+static int promotionPieceType(MovePromotions promotion) {
+    switch (promotion) {
+        case MovePromotions::Q:
+            return 4;
+        case MovePromotions::R:
+            return 1;
+        case MovePromotions::N:
+            return 2;
+        case MovePromotions::B:
+            return 3;
+        case MovePromotions::None:
+            break;
+    }
+    return 0;
+}
+
+int Board::getPieceOn(int square) const {
+    U64 mask = 1ULL << square;
+    for (int bb = 0; bb < 12; bb++) {
+        if (boards[bb] & mask) {
+            return bb;
+        }
+    }
+    return -1;
+}
+
+U64 Board::attackersTo(int square, U64 occupied) const {
+    U64 rooks = boards[(int)BitBoards::RW] | boards[(int)BitBoards::RB] | boards[(int)BitBoards::QW] | boards[(int)BitBoards::QB];
+    U64 bishops = boards[(int)BitBoards::BW] | boards[(int)BitBoards::BB] | boards[(int)BitBoards::QW] | boards[(int)BitBoards::QB];
+
+    U64 attackers = 0;
+    // a white pawn attacks square from where a black pawn on square would capture, and vice versa
+    attackers |= PAWN_ATTACKS[(int)Side::Black][square] & boards[(int)BitBoards::PW];
+    attackers |= PAWN_ATTACKS[(int)Side::White][square] & boards[(int)BitBoards::PB];
+    attackers |= KNIGHT_ATTACKS[square] & (boards[(int)BitBoards::NW] | boards[(int)BitBoards::NB]);
+    attackers |= KING_ATTACKS[square] & (boards[(int)BitBoards::KW] | boards[(int)BitBoards::KB]);
+    attackers |= rookAttacks(square, occupied) & rooks;
+    attackers |= bishopAttacks(square, occupied) & bishops;
+    return attackers;
+}
+
+// https://www.chessprogramming.org/SEE_-_The_Swap_Algorithm
+// both sides take back on the target square with their least valuable attacker, after every capture the sliders
+// behind the capturing piece are uncovered. Each side may stop capturing when that is better for it
+bool Board::see(const GenMove& move, int threshold) {
+    if (move.type >= MoveTypes::CastleWhiteKing) {
+        return threshold <= 0;
+    }
+
+    int from = move.from, to = move.to;
+    U64 occupied = _occupied ^ (1ULL << from);
+
+    int victim = getPieceOn(to);
+    int swap = victim < 0 ? 0 : PIECE_VALUES[victim % 6];
+    int moved = (int)move.bb % 6;
+    if (move.type == MoveTypes::EnpasKing || move.type == MoveTypes::EnpasQueen) {
+        swap = PIECE_VALUES[0];
+        occupied ^= 1ULL << (side == Side::White ? to - 8 : to + 8);
+    } else if (move.promotion != MovePromotions::None) {
+        moved = promotionPieceType(move.promotion);
+        swap += PIECE_VALUES[moved] - PIECE_VALUES[0];
+    }
+
+    // the gain if the opponent does not recapture
+    swap -= threshold;
+    if (swap < 0) {
+        return false;
+    }
+    // the gain if the moved piece is lost for nothing
+    swap = PIECE_VALUES[moved] - swap;
+    if (swap <= 0) {
+        return true;
+    }
+
+    U64 rooks = boards[(int)BitBoards::RW] | boards[(int)BitBoards::RB] | boards[(int)BitBoards::QW] | boards[(int)BitBoards::QB];
+    U64 bishops = boards[(int)BitBoards::BW] | boards[(int)BitBoards::BB] | boards[(int)BitBoards::QW] | boards[(int)BitBoards::QB];
+    U64 attackers = attackersTo(to, occupied);
+    Side stm = side;
+    // 1 while the side to move of the board wins the exchange so far
+    int result = 1;
+
+    while (true) {
+        stm = stm == Side::White ? Side::Black : Side::White;
+        attackers &= occupied;
+        int offset = stm == Side::White ? 0 : 6;
+        U64 own = stm == Side::White ? _whitePieces : _blackPieces;
+        U64 stmAttackers = attackers & own;
+        if (!stmAttackers) {
+            break;
+        }
+        result ^= 1;
+
+        // least valuable attacker, ordered by value
+        int type = -1;
+        U64 pieces = 0;
+        for (int t : {0, 2, 3, 1, 4, 5}) {
+            pieces = stmAttackers & boards[offset + t];
+            if (pieces) {
+                type = t;
+                break;
+            }
+        }
+        if (type == 5) {
+            // the king may only capture if the square is not defended any more
+            return (attackers & ~own) ? result ^ 1 : result;
+        }
+        swap = PIECE_VALUES[type] - swap;
+        if (swap < result) {
+            break;
+        }
+        occupied ^= pieces & -pieces;
+        // uncover x-ray attackers behind the piece which just captured
+        if (type == 0 || type == 3 || type == 4) {
+            attackers |= bishopAttacks(to, occupied) & bishops;
+        }
+        if (type == 1 || type == 4) {
+            attackers |= rookAttacks(to, occupied) & rooks;
+        }
+    }
+    return result;
+}
+
+U64 Board::getOccupied() const {
     return _occupied;
 }
 
-U64 Board::getWhitePieces() {
-    useDerivedState();
+U64 Board::getWhitePieces() const {
     return _whitePieces;
 }
 
-U64 Board::getBlackPieces() {
-    useDerivedState();
+U64 Board::getBlackPieces() const {
     return _blackPieces;
 }
 
 U64 Board::getUnsafeForWhite() {
-    useDerivedState();
-    return _unsafeForWhite;
+    return useUnsafeFor(Side::White);
 }
 
 U64 Board::getUnsafeForBlack() {
-    useDerivedState();
-    return _unsafeForBlack;
+    return useUnsafeFor(Side::Black);
 }
 
 void BoardEditRecorder::record(BoardEdit edit) {
@@ -24,6 +24,29 @@ struct BoardEditRecorder {
     void clear();
 };
 
+enum class MoveGenType {
+    All,
+    Noisy,  // captures, en passant and promotions
+    Quiet,  // all other moves
+};
+
+// parts of the derived state, each one is only computed when it is read after the position changed
+enum class DerivedState {
+    UnsafeForWhite = 1,
+    UnsafeForBlack = 2,
+    Pins = 4,  // checkers, pinned pieces and evasion mask of the side to move
+};
+
+// board state which is restored directly when a move is taken back. The derived state is part of it
+// so the parent does not have to recompute it
+struct BoardUndo {
+    U64 enpassantTarget;
+    char castlingRights;
+    U64 hash;
+    U64 unsafeForWhite, unsafeForBlack, checkers, pinned, checkMask;
+    char derivedValid;
+};
+
 class Board {
 public:
     Side getSideToMove() const;
@@ -32,23 +55,39 @@ public:
     U64 getEnpassantTarget() const;
     U64 getHash() const;
     bool hasCheck(CheckFlags checkingSide) const;
+    // side to move is in check
+    bool isInCheck();
+    bool hasNonPawnMaterial(Side side) const;
+    // bitboard index of the piece on square, -1 if it is empty
+    int getPieceOn(int square) const;
+    // pieces of both sides attacking square, sliding attacks are only blocked by occupied
+    U64 attackersTo(int square, U64 occupied) const;
+    // static exchange evaluation, true if the exchange started by move wins at least threshold for the side to move
+    bool see(const GenMove& move, int threshold);
 
     bool movePieceOrCapture(BitBoards bb, int from, int to);
     void forbidCastling(CastlingTypes castling);
     void placePiece(BitBoards bb, int square);
     void removePiece(BitBoards bb, int square);
     void switchSide();
+    void passTurn();
     void setEnpassantTarget(U64 newTarget);
+    void saveUndo(BoardUndo& undo) const;
+    void restoreUndo(const BoardUndo& undo);
 
     void sanityCheck();
-    bool isLegal();
+    // false if the side which just moved left its king in check
+    bool isLegal() const;
 
-    void generatePseudoMoves(MoveList& moveList);
-    void orderAndFilterMoveList(MoveList& moveList, const LanMove& pv, bool capturesOnly) const;
+    // only legal moves are generated, so every move can be made without checking it afterwards
+    void generateMoves(MoveList& moveList);
+    void generateMoves(MoveList& moveList, MoveGenType type);
+    // finds the legal move matching lanMove without generating all moves, false if there is none
+    bool findMove(const LanMove& lanMove, GenMove& move);
 
-    U64 getOccupied();
-    U64 getWhitePieces();
-    U64 getBlackPieces();
+    U64 getOccupied() const;
+    U64 getWhitePieces() const;
+    U64 getBlackPieces() const;
     U64 getUnsafeForWhite();
     U64 getUnsafeForBlack();
 
@@ -61,24 +100,33 @@ private:
     Side side = Side::White;
     U64 hash = 0;
 
-    // derived state (always underscored)
-    U64 _lastDerivedHash = 1;
-    U64 _occupied = 0, _whitePieces = 0, _blackPieces = 0, _unsafeForWhite = 0, _unsafeForBlack = 0;
-    char _checks = 0;
+    // kept up to date by placePiece and removePiece
+    U64 _occupied = 0, _whitePieces = 0, _blackPieces = 0;
+
+    // derived state (always underscored), the parts flagged in _derivedValid are up to date
+    char _derivedValid = 0;
+    U64 _unsafeForWhite = 0, _unsafeForBlack = 0;
+    // for the side to move: enemy pieces giving check, own pieces pinned to the king and
+    // the squares a piece other than the king may move to (everything, checker and blocking squares, or none)
+    U64 _checkers = 0, _pinned = 0, _checkMask = ~0ULL;
 
-    void useDerivedState();
+    U64 useUnsafeFor(Side side);
+    void usePins();
+    // everything move generation for the side to move reads
+    void useMoveGenState();
     U64 findUnsafeForWhite() const;
     U64 findUnsafeForBlack() const;
+    void findPinsAndCheckers();
+    bool isLegalEnpassant(int from) const;
 
     void genCastlesWhite(MoveList& moves) const;
     void genCastlesBlack(MoveList& moves) const;
-    void genMovesSlidingPieces(MoveList& moveList, BitBoards bb, bool paral, bool diag) const;
-    void genKingMoves(MoveList& moves) const;
-    void genKnightMoves(MoveList& moves) const;
-    void genPawnMovesWhite(MoveList& moves) const;
-    void genPawnMovesBlack(MoveList& moves) const;
-    U64 getHAndVMoves(int index) const;
-    U64 getDandAntiDMoves(int index) const;
+    void genMovesSlidingPieces(MoveList& moveList, BitBoards bb, bool paral, bool diag, U64 targets) const;
+    void genKingMoves(MoveList& moves, U64 targets) const;
+    void genKnightMoves(MoveList& moves, U64 targets) const;
+    void genPawnMoves(MoveList& moves, U64 targets) const;
+    void genPawnMovesWhite(MoveList& moves, U64 pawns, U64 targets) const;
+    void genPawnMovesBlack(MoveList& moves, U64 pawns, U64 targets) const;
     void addMovesFromBitboardSingle(MoveList& moves, U64 destinations, int position, BitBoards bb) const;
     void addMovesFromBitboardParallelPromote(MoveList& moves, U64 destinations, int offset, BitBoards bb) const;
     void addMovesFromBitboardParallel(MoveList& moves, U64 destinations, int offset, BitBoards bb, MoveTypes type) const;
@@ -1,29 +1,40 @@
 ﻿#include "computer.h"
 
+#include <algorithm>
+#include <cmath>
 #include <set>
+#include <thread>
 #include <vector>
 
 #include "position.h"
 
+int lmrReductions[MAX_SEARCH_PLY][MAXIMUM_POSSIBLE_MOVES];
+
+void InitReductions() {
+    for (int depth = 1; depth < MAX_SEARCH_PLY; depth++) {
+        for (int moveNumber = 1; moveNumber < MAXIMUM_POSSIBLE_MOVES; moveNumber++) {
+            lmrReductions[depth][moveNumber] = (int)(0.75 + std::log(depth) * std::log(moveNumber) / 2.25);
+        }
+    }
+}
+
 long Computer::perft(Position& curr, int depth) {
-    if (depth == 0) {
-        return 1;
+    MoveList moves;
+    curr.board.generateMoves(moves);
+    // every generated move is legal, so the last ply is just counted
+    if (depth <= 1) {
+        return depth == 1 ? moves.size : 1;
     }
 
     long count = 0;
-    MoveList pseudoMoves;
-    curr.board.generatePseudoMoves(pseudoMoves);
-
-    for (const GenMove& m : pseudoMoves) {
-        Position next(curr);
+    UndoRecord undo;
+    for (const GenMove& m : moves) {
         if (!isWorking) {
             break;
         }
-        next.movePseudoInPlace(m);
-        if (!next.board.isLegal()) {
-            continue;  // illegal move
-        }
-        count += perft(next, depth - 1);  // recurse
+        curr.makeMove(m, undo);
+        count += perft(curr, depth - 1);  // recurse
+        curr.unmakeMove(m, undo);
     }
     return count;
 }
@@ -33,19 +44,17 @@ void Computer::launchPerft(Position& root, int depth) {
 
     long total = 0;
 
-    MoveList pseudoMoves;
-    root.board.generatePseudoMoves(pseudoMoves);
+    MoveList moves;
+    root.board.generateMoves(moves);
 
-    for (const GenMove& m : pseudoMoves) {
-        Position next(root);
+    UndoRecord undo;
+    for (const GenMove& m : moves) {
         if (!isWorking) {
             break;
         }
-        next.movePseudoInPlace(m);
-        if (!next.board.isLegal()) {
-            continue;  // illegal move
-        }
-        long moveScore = perft(next, depth - 1);  // recurse
+        root.makeMove(m, undo);
+        long moveScore = perft(root, depth - 1);  // recurse
+        root.unmakeMove(m, undo);
         total += moveScore;
 
         std::cout << m.toLanMove().toString() << ": " << moveScore << std::endl;
@@ -85,75 +94,76 @@ void Computer::launchTest(Position root, ComputerTests testType, int depth) {
 }
 
 // time managment
-bool Computer::mustStopSearching() {
-    if (task.params.getBoolField("infinite")) {
+// checked by the main thread between iterations, the hard time limit is enforced by the timer
+bool Computer::mustStopSearching(int iterativeDepth) {
+    const SearchParams& params = task.params;
+    if (params.infinite) {
         return false;  // never stop here
     }
 
     // depth <x>
-    long depthParam = task.params.getLongField("depth");
-    if (depthParam > 0 && task.iterativeDepth > depthParam) {
+    if (params.depth > 0 && iterativeDepth > params.depth) {
         return true;
     }
 
-    // nodes <x>, mate <x>,
-    // TODO
-
-    auto curr = std::chrono::high_resolution_clock::now();
-    long totalMillis = std::chrono::duration_cast<std::chrono::milliseconds>(curr - task.startTime).count();
-
-    // movetime <ms>
-    long movetimeParam = task.params.getLongField("movetime");
-    if (movetimeParam > 0 && totalMillis >= movetimeParam) {
-        return true;
+    // mate <x>, a mate in at most x moves was found
+    const SearchWorker& main = *workers[0];
+    if (params.mate > 0 && main.completedDepth > 0 && main.rootScore > MAX_EVAL) {
+        long matePlies = SCORE_CHECKMATE - main.rootScore;
+        if ((matePlies + 1) / 2 <= params.mate) {
+            return true;
+        }
     }
 
-    long fullMovesCount = task.rootPosition.fullMovesCount;
-
-    float wtime = (float)task.params.getLongField("wtime");
-    float btime = (float)task.params.getLongField("btime");
-    float winc = (float)task.params.getLongField("winc");
-    float binc = (float)task.params.getLongField("binc");
-    long movestogo = task.params.getLongField("movestogo");
+    return !timeManager.canStartIteration(elapsedMillis());
+}
 
-    bool isWhite = task.rootPosition.board.getSideToMove() == Side::White;
-    float remainingTime = isWhite ? wtime : btime;
-    float increment = isWhite ? winc : binc;
+long Computer::elapsedMillis() const {
+    auto curr = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(curr - task.startTime).count();
+}
 
-    if (remainingTime > 0) {
-        // do time management
-        if (increment < 0) {
-            increment = 0;
-        }
-        if (movestogo <= 0) {
-            // sudden death
-            movestogo = std::max(20L, 40L - fullMovesCount);
+void Computer::startTimer() {
+    long timeLimit = timeManager.getHardLimit();
+    if (timeLimit < 0) {
+        return;
+    }
+    searchDone = false;
+    auto deadline = task.startTime + std::chrono::milliseconds(timeLimit);
+    timer = std::thread([this, deadline] {
+        std::unique_lock<std::mutex> lock(timerLock);
+        if (!timerWakeup.wait_until(lock, deadline, [this] { return searchDone; })) {
+            isWorking = false;
         }
+    });
+}
 
-        float availableTime = remainingTime + increment * movestogo;
-        float moveLimitMillis = availableTime / movestogo;
-
-        // limit time in opening
-        float minOpeningFactor = 0.33;
-        int openingFullMoves = 8;
-        float openingFactor = std::max(minOpeningFactor, std::min(fullMovesCount / (float)openingFullMoves, 1.0f));
-
-        moveLimitMillis *= openingFactor;
-
-        // factor in some delay
-        moveLimitMillis = 0.8 * (moveLimitMillis - 500);
+void Computer::stopTimer() {
+    if (!timer.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(timerLock);
+        searchDone = true;
+    }
+    timerWakeup.notify_all();
+    timer.join();
+}
 
-        if (totalMillis > moveLimitMillis) {
-            return true;
-        }
+Score SearchWorker::evaluate_relative(Board& board, int depth) {
+    if (!nnue_loaded()) {
+        return evaluate_qualitative(board);
     }
 
-    return false;
-}
+    // transpositions are evaluated without materialising their accumulators
+    Score cached;
+    evalCacheProbes++;
+    if (computer.evalCache.probe(board.getHash(), cached)) {
+        evalCacheHits++;
+        return cached;
+    }
 
-Score Computer::evaluate_relative(Board& board, int depth) {
     int32_t eval = accumulators.forward(depth, board.getSideToMove(), board.getOccupied());
-    // Score eval = evaluate_qualitative(board);
 
     if (eval < -MAX_EVAL) {
         eval = -MAX_EVAL;
@@ -161,20 +171,36 @@ Score Computer::evaluate_relative(Board& board, int depth) {
         eval = MAX_EVAL;
     }
 
+    computer.evalCache.store(board.getHash(), (Score)eval);
     return (Score)eval;
 }
 
-Score Computer::quiescence(Position& pos, int currentDepth, Score alpha, Score beta) {
+// fifty move rule and repetitions. A position of the search line repeating once is already scored as a draw,
+// the side which could avoid it would already have done so. Positions played before the root must occur twice
+bool SearchWorker::isDraw(const Position& pos, int pliesSinceNull) const {
+    if (pos.noCaptureOrPush >= 100) {
+        return true;
+    }
 
-    task.currNodesSearched++;
-    // only rarely check if out of time
-    if (task.currNodesSearched % 100000 == 0) {
-        if (mustStopSearching()) {
-            isWorking = false;
+    // only positions since the last capture or pawn move can repeat, and only with the same side to move.
+    // Positions before a null move cannot be repeated by the real moves after it
+    U64 key = pos.board.getHash();
+    int size = keyStack.size();
+    int oldest = std::max(0, size - std::min((int)pos.noCaptureOrPush, pliesSinceNull));
+    int earlierOccurrences = 0;
+    for (int i = size - 4; i >= oldest; i -= 2) {
+        if (keyStack[i] == key && (i >= rootKeyIndex || ++earlierOccurrences == 2)) {
+            return true;
         }
     }
+    return false;
+}
 
-    if (!isWorking) {
+Score SearchWorker::quiescence(Position& pos, int currentDepth, Score alpha, Score beta) {
+
+    countNode();
+
+    if (stopped()) {
         return alpha;
     }
     
@@ -188,24 +214,31 @@ Score Computer::quiescence(Position& pos, int currentDepth, Score alpha, Score b
         alpha = standPat;
     }
 
-    MoveList captures;
-    pos.board.generatePseudoMoves(captures);
-    // TODO: maybe consider adding pv but it may be slower here
-    pos.board.orderAndFilterMoveList(captures, LanMove::NullMove(), true);
+    if (currentDepth >= MAX_SEARCH_PLY - 1) {
+        return alpha;
+    }
 
-    for (GenMove& m : captures) {
+    SearchStackEntry& ss = stack[currentDepth];
+    MovePicker picker(pos.board, ss.moves);
+    GenMove m;
 
-        Position nextPos(pos);
-        accumulators.markDirty(currentDepth + 1);
-        nextPos.board.editRecorder = accumulators.getRecorder(currentDepth + 1);
-        nextPos.movePseudoInPlace(m);
-        nextPos.board.editRecorder = nullptr;
+    while (picker.next(m)) {
 
-        if (!nextPos.board.isLegal()) {
-            continue;
+        // delta pruning, even winning the captured piece for free would not raise alpha
+        if (computer.options.deltaPruning && m.promotion == MovePromotions::None) {
+            int victim = std::max(pos.board.getPieceOn(m.to), 0) % 6;  // en passant lands on an empty square
+            if (standPat + PIECE_VALUES[victim] + DELTA_MARGIN <= alpha) {
+                continue;
+            }
         }
 
-        Score score = -quiescence(nextPos, currentDepth + 1, -beta, -alpha);
+        accumulators.markDirty(currentDepth + 1);
+        pos.board.editRecorder = accumulators.getRecorder(currentDepth + 1);
+        pos.makeMove(m, ss.undo);
+        pos.board.editRecorder = nullptr;
+
+        Score score = -quiescence(pos, currentDepth + 1, -beta, -alpha);
+        pos.unmakeMove(m, ss.undo);
 
         if (score >= beta) {
             // prune branch
@@ -219,109 +252,222 @@ Score Computer::quiescence(Position& pos, int currentDepth, Score alpha, Score b
     return alpha;
 }
 
-Score Computer::search(Position& pos, int currentDepth, Score alpha, Score beta) {
-    int remainingDepth = task.iterativeDepth - currentDepth;
+Score SearchWorker::search(Position& pos, int currentDepth, int depth, Score alpha, Score beta) {
+    const SearchOptions& options = computer.options;
+
+    SearchStackEntry& ss = stack[currentDepth];
+    if (currentDepth == 0) {
+        ss.pliesSinceNull = keyStack.size();
+    } else {
+        SearchStackEntry& parent = stack[currentDepth - 1];
+        ss.pliesSinceNull = parent.move.isNullMove() ? 0 : parent.pliesSinceNull + 1;
+    }
+
+    if (currentDepth > 0 && isDraw(pos, ss.pliesSinceNull)) {
+        return 0;
+    }
 
     LanMove lastPv = LanMove::NullMove();
-    auto boardEntry = searchTable.find(pos.board.getHash());
-    if (boardEntry != searchTable.end()) {
-        if (boardEntry->second.knownDepth >= remainingDepth) {
+    TTEntry ttEntry;
+    if (computer.transpositionTable.probe(pos.board.getHash(), ttEntry)) {
+        Score ttScore = scoreFromTT(ttEntry.score, currentDepth);
+        Bound bound = ttEntry.getBound();
+        // the root is always searched so it keeps a move
+        if (currentDepth > 0 && ttEntry.depth >= depth &&
+            (bound == Bound::Exact ||
+             (bound == Bound::Lower && ttScore >= beta) ||
+             (bound == Bound::Upper && ttScore <= alpha))) {
             // has already more knowledge over this node => skip
-            return boardEntry->second.score;
+            return ttScore;
         }
         // grab last pv
-        lastPv = boardEntry->second.pv.toLanMove();
-    }
-    if (boardEntry != searchTable.end() &&
-        boardEntry->second.knownDepth >= remainingDepth) {
-        // has already more knowledge over this node => skip
-        return boardEntry->second.score;
+        lastPv = ttEntry.getMove();
     }
 
-    if (currentDepth >= task.iterativeDepth) {
+    if (depth <= 0 || currentDepth >= MAX_SEARCH_PLY - 1) {
         return quiescence(pos, currentDepth, alpha, beta);
-        // return evaluate_relative(pos.board, accumulators, currentDepth);
     }
 
-    task.currNodesSearched++;
+    countNode();
 
-    // only rarely check if out of time
-    if (task.currNodesSearched % 100000 == 0) {
-        if (mustStopSearching()) {
-            isWorking = false;
+    if (stopped()) {
+        return alpha;
+    }
+
+    bool pvNode = beta - alpha > 1;
+    bool inCheck = pos.board.isInCheck();
+    Side us = pos.board.getSideToMove();
+    GenMove* previous = currentDepth > 0 && !stack[currentDepth - 1].move.isNullMove() ? &stack[currentDepth - 1].move : nullptr;
+
+    // forward pruning, only where the window is null and the static eval is meaningful
+    Score staticEval = 0;
+    bool canPrune = currentDepth > 0 && !pvNode && !inCheck;
+    if (canPrune) {
+        staticEval = evaluate_relative(pos.board, currentDepth);
+
+        // reverse futility, so far above beta that a shallow search will not drop below it
+        if (options.reverseFutility && depth <= RFP_MAX_DEPTH && std::abs(beta) < MAX_EVAL &&
+            staticEval - RFP_MARGIN * depth >= beta) {
+            return staticEval;
+        }
+
+        // null move, if passing still fails high the real moves will too. Without pieces
+        // passing may be the only good move (zugzwang), so the side must have some left
+        bool previousWasNull = currentDepth > 0 && stack[currentDepth - 1].move.isNullMove();
+        if (options.nullMove && depth >= NULL_MOVE_MIN_DEPTH && staticEval >= beta && !previousWasNull &&
+            pos.board.hasNonPawnMaterial(pos.board.getSideToMove())) {
+            int reduction = 3 + depth / 6;
+
+            accumulators.markDirty(currentDepth + 1);
+            accumulators.getRecorder(currentDepth + 1);
+            keyStack.push_back(pos.board.getHash());
+            pos.makeNullMove(ss.undo);
+            ss.move = GenMove::NullMove();
+            Score score = -search(pos, currentDepth + 1, depth - 1 - reduction, -beta, -beta + 1);
+            pos.unmakeNullMove(ss.undo);
+            keyStack.pop_back();
+
+            if (stopped()) {
+                return alpha;
+            }
+            if (score >= beta) {
+                // unproven mates are not returned
+                return score > MAX_EVAL ? beta : score;
+            }
         }
     }
-    if (!isWorking) {
-        return alpha;
+
+    // futility, quiet moves cannot raise a static eval this far below alpha at the last plies
+    bool futilityPruning = canPrune && options.futility && depth <= FUTILITY_MAX_DEPTH &&
+                           std::abs(alpha) < MAX_EVAL && staticEval + FUTILITY_MARGIN * depth <= alpha;
+    Score futilityValue = staticEval + FUTILITY_MARGIN * depth;
+
+    if (currentDepth == 0) {
+        rootSearchStartNodes = nodesSearched.load(std::memory_order_relaxed);
+        rootBestMoveNodes = 0;
     }
 
+    Score originalAlpha = alpha;
     Score bestScore = -SCORE_CHECKMATE + currentDepth;
     GenMove bestMove = GenMove::NullMove();
-    MoveList moves;
-    pos.board.generatePseudoMoves(moves);
-    pos.board.orderAndFilterMoveList(moves, lastPv, false);
+    MovePicker picker(pos.board, ss.moves, lastPv, heuristics, currentDepth, previous);
+    GenMove m;
+    ss.numQuietsTried = 0;
+    int movesSearched = 0;
 
-    for (GenMove& m : moves) {
+    while (picker.next(m)) {
 
-        Position nextPos(pos);
         accumulators.markDirty(currentDepth + 1);
-        nextPos.board.editRecorder = accumulators.getRecorder(currentDepth + 1);
-        nextPos.movePseudoInPlace(m);
-        nextPos.board.editRecorder = nullptr;
+        pos.board.editRecorder = accumulators.getRecorder(currentDepth + 1);
+        pos.makeMove(m, ss.undo);
+        pos.board.editRecorder = nullptr;
+
+        if (bestMove.isNullMove()) {
+            bestMove = m;
+        }
 
-        if (!nextPos.board.isLegal()) {
+        bool isQuiet = m.capture == CaptureType::NonCapture && m.type != MoveTypes::Promote;
+
+        if (futilityPruning && isQuiet && movesSearched > 0 && !pos.board.isInCheck()) {
+            pos.unmakeMove(m, ss.undo);
+            if (futilityValue > bestScore) {
+                bestScore = futilityValue;
+            }
             continue;
         }
 
-        if (bestMove.isNullMove()) {
-            bestMove = m;
+        ss.move = m;
+        keyStack.push_back(ss.undo.board.hash);  // the board is already moved, the undo record holds the key of this node
+        long nodesBefore = nodesSearched.load(std::memory_order_relaxed);
+        Score score;
+        if (movesSearched == 0) {
+            score = -search(pos, currentDepth + 1, depth - 1, -beta, -alpha);
+        } else {
+            // late quiet moves are unlikely to be best, so they are first searched with less depth
+            int reduction = 0;
+            if (options.lateMoveReductions && depth >= LMR_MIN_DEPTH && movesSearched >= (pvNode ? 3 : 2) && isQuiet &&
+                !inCheck && !pos.board.isInCheck()) {
+                reduction = lmrReductions[std::min(depth, MAX_SEARCH_PLY - 1)][std::min(movesSearched, MAXIMUM_POSSIBLE_MOVES - 1)];
+                reduction -= heuristics.getQuietScore(us, m) / (HISTORY_MAX / 2);
+                if (pvNode) {
+                    reduction--;
+                }
+                reduction = std::clamp(reduction, 0, depth - 2);
+            }
+
+            // principal variation search, later moves only have to be proven worse than the best so far
+            score = -search(pos, currentDepth + 1, depth - 1 - reduction, -alpha - 1, -alpha);
+            if (reduction > 0 && score > alpha) {
+                score = -search(pos, currentDepth + 1, depth - 1, -alpha - 1, -alpha);
+            }
+            if (score > alpha && score < beta) {
+                score = -search(pos, currentDepth + 1, depth - 1, -beta, -alpha);
+            }
         }
+        keyStack.pop_back();
+        movesSearched++;
+        pos.unmakeMove(m, ss.undo);
 
-        Score score = -search(nextPos, currentDepth + 1, -beta, -alpha);
+        if (stopped()) {
+            // score of an interrupted subtree is meaningless
+            return alpha;
+        }
 
         if (score >= beta) {
             // prune branch
+            if (isQuiet) {
+                heuristics.updateQuietCutoff(currentDepth, depth, pos.board.getSideToMove(), m, ss.quietsTried, ss.numQuietsTried, previous);
+            }
+            computer.transpositionTable.store(pos.board.getHash(), m.toLanMove(), scoreToTT(score, currentDepth), depth, Bound::Lower);
             return score;
         }
 
+        if (isQuiet && ss.numQuietsTried < MAX_QUIETS_TRIED) {
+            ss.quietsTried[ss.numQuietsTried++] = m;
+        }
+
         if (score > bestScore) {
             bestScore = score;
             bestMove = m;
+            if (currentDepth == 0) {
+                rootBestMoveNodes = nodesSearched.load(std::memory_order_relaxed) - nodesBefore;
+                // an exact score is final even if the iteration does not finish, so this move beats the last iteration's
+                if (score > alpha && score < beta) {
+                    rootMove = m.toLanMove();
+                    rootScore = score;
+                }
+            }
         }
         if (score > alpha) {
             alpha = score;
         }
     }
 
-    if (!isWorking) {
+    if (stopped()) {
         return alpha;
     }
 
-    bool stalemate = false;  // add counting remaining pieces and threefold repetition
-
     if (bestMove.isNullMove()) {
-        // no moves
-        if (pos.board.getSideToMove() == Side::White) {
-            if (!(pos.board.hasCheck(CheckFlags::WhiteInCheck))) {
-                // white has no moves but is not in check
-                stalemate = true;
-            }
-        } else if (!(pos.board.hasCheck(CheckFlags::BlackInCheck))) {
-            stalemate = true;
-        }
-    }
-    if (stalemate) {
-        bestScore = 0;
+        // no legal moves, mate or stalemate
+        bestScore = inCheck ? -SCORE_CHECKMATE + currentDepth : 0;
     }
 
-    searchTable[pos.board.getHash()] = { .pv = bestMove, .score = bestScore, .knownDepth = (short)remainingDepth };
+    // without moves the score is exact, otherwise no move raising alpha means only an upper bound is known
+    Bound bound = bestMove.isNullMove() || bestScore > originalAlpha ? Bound::Exact : Bound::Upper;
+    computer.transpositionTable.store(pos.board.getHash(), bestMove.toLanMove(), scoreToTT(bestScore, currentDepth), depth, bound);
+
+    if (currentDepth == 0) {
+        // other threads may overwrite the root entry, so the move is kept with this worker
+        currRootMove = bestMove.toLanMove();
+    }
 
     return bestScore;
 }
 
-std::string Computer::getPvList(Position board) {
+std::string Computer::getPvList(Position board, LanMove firstMove) {
     std::string pvList = "";
     std::set<U64> previousHashes;
+    LanMove lanMove = firstMove;
 
     while (true) {
         U64 hash = board.board.getHash();
@@ -331,20 +477,44 @@ std::string Computer::getPvList(Position board) {
         }
         previousHashes.insert(hash);
 
-        auto res = searchTable.find(hash);
-        if (res == searchTable.end() || res->second.pv.isNullMove()) {
+        if (lanMove.isNullMove()) {
+            TTEntry entry;
+            if (!transpositionTable.probe(hash, entry) || entry.getMove().isNullMove()) {
+                return pvList;
+            }
+            lanMove = entry.getMove();
+        }
+        // entries only verify part of the hash, so the move must be checked against the position
+        MoveList moves;
+        board.board.generateMoves(moves);
+        GenMove m = GenMove::NullMove();
+        for (GenMove& candidate : moves) {
+            if (candidate.matchesLanMove(lanMove)) {
+                m = candidate;
+                break;
+            }
+        }
+        if (m.isNullMove()) {
             return pvList;
         }
-        GenMove m = res->second.pv;
         if (pvList.length() > 0) {
             pvList += " ";
         }
         pvList += m.toLanMove().toString();
         board.movePseudoInPlace(m);
+        lanMove = LanMove::NullMove();
     }
 }
 
-void Computer::generateComputerInfo() {
+long Computer::totalNodesSearched() const {
+    long total = 0;
+    for (const std::unique_ptr<SearchWorker>& worker : workers) {
+        total += worker->nodesSearched.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void Computer::generateComputerInfo(const SearchWorker& worker) {
     auto curr = std::chrono::high_resolution_clock::now();
     long micros = std::chrono::duration_cast<std::chrono::microseconds>(curr - task.lastTime).count();
     task.lastTime = curr;
@@ -353,27 +523,22 @@ void Computer::generateComputerInfo() {
         return;
     }
 
+    // nodes of all threads
+    long totalNodes = totalNodesSearched();
+
     ComputerInfo info;
-    info.depth = task.iterativeDepth;
-    info.nodes = task.prevTotalNodesSearched + task.currNodesSearched;
-    info.nps = (long)((float)task.currNodesSearched / seconds);
+    info.depth = worker.completedDepth;
+    info.nodes = totalNodes;
+    info.nps = (long)((float)(totalNodes - task.prevTotalNodesSearched) / seconds);
 
-    task.prevTotalNodesSearched += task.currNodesSearched;
-    task.currNodesSearched = 0;
+    task.prevTotalNodesSearched = totalNodes;
 
-    auto hit = searchTable.find(task.rootPosition.board.getHash());
-    if (hit == searchTable.end()) {
-        printf("root not found\n");
-        return;
-    }
-    SearchNode& node = hit->second;
-
-    info.score = node.score;
+    info.score = worker.rootScore;
     if (task.rootPosition.board.getSideToMove() == Side::Black) {
-        info.score = -node.score;
+        info.score = -worker.rootScore;
     }
 
-    info.pv = getPvList(task.rootPosition);
+    info.pv = getPvList(task.rootPosition, worker.rootMove);
 
     std::lock_guard<std::mutex> guard(outputLock);
     infoBuffer.push_back(info);
@@ -388,65 +553,194 @@ class ScopedWorkingGuard {
     ~ScopedWorkingGuard() { flag = false; }
 };
 
-/**
- * Expects that a task has been set on the computer.
- */
-void Computer::launchSearch() {
-    if (isWorking) {
-        return;
+SearchWorker::SearchWorker(Computer& computer, int id) : computer(computer), id(id) {}
+
+// the only check of the hot path, whoever ends the search clears isWorking
+bool SearchWorker::stopped() const {
+    return !computer.isWorking.load(std::memory_order_relaxed);
+}
+
+void SearchWorker::countNode() {
+    // only this thread writes the counter, so no atomic read-modify-write is needed
+    long nodes = nodesSearched.load(std::memory_order_relaxed) + 1;
+    nodesSearched.store(nodes, std::memory_order_relaxed);
+
+    // the node limit is split between the threads, with one thread the search is reproducible
+    if (nodes == nodeLimit) {
+        computer.isWorking.store(false, std::memory_order_relaxed);
     }
+}
 
-    // ensures is working will always be turned off on return
-    ScopedWorkingGuard workingGuard(isWorking);
+void SearchWorker::iterativeDeepening() {
+    Position root = computer.task.rootPosition;
+    completedDepth = 0;
+    rootScore = 0;
+    rootMove = LanMove::NullMove();
+    nodesSearched = 0;
+    evalCacheProbes = evalCacheHits = 0;
 
-    searchTable.clear();
+    long totalNodeLimit = computer.task.params.nodes;
+    nodeLimit = totalNodeLimit > 0 ? std::max(1L, totalNodeLimit / (long)computer.workers.size()) : -1;
 
-    accumulators.init(task.rootPosition.board);
+    keyStack = computer.task.gameKeys;
+    keyStack.reserve(keyStack.size() + MAX_SEARCH_PLY);
+    rootKeyIndex = keyStack.size();
 
-    for (task.iterativeDepth = 1;; task.iterativeDepth++) {
+    if (nnue_loaded()) {
+        accumulators.init(root.board);
+    }
+    heuristics.clear();
 
-        if (mustStopSearching()) {
-            isWorking = false;
+    // every other helper starts one ply deeper, so the threads spread over different depths
+    // and fill the shared table with results which the others pick up
+    for (iterativeDepth = 1 + (id % 2);; iterativeDepth++) {
+
+        if (id == 0 && computer.mustStopSearching(iterativeDepth)) {
+            computer.isWorking = false;
         }
 
-        if (!isWorking) {
+        if (stopped() || iterativeDepth >= MAX_SEARCH_PLY) {
             break;
         }
 
-        Score score = search(task.rootPosition, 0, -SCORE_CHECKMATE, SCORE_CHECKMATE);
-        generateComputerInfo();
+        Score score = aspirationSearch(root, rootScore);
 
-        if (isWorking) {
-            // <=> was complete search iteration
-            bool someSideIsCheckmating = std::abs(score) > MAX_EVAL;
-            if (someSideIsCheckmating) {
-                // root position is terminal node
-                break;
-            }
+        if (stopped()) {
+            // incomplete iteration
+            break;
         }
 
+        heuristics.age();
+        completedDepth = iterativeDepth;
+        rootScore = score;
+        rootMove = currRootMove;
+        if (id == 0) {
+            computer.generateComputerInfo(*this);
+            long rootNodes = nodesSearched.load(std::memory_order_relaxed) - rootSearchStartNodes;
+            double bestMoveNodeShare = rootNodes > 0 ? (double)rootBestMoveNodes / rootNodes : 1.0;
+            computer.timeManager.iterationDone(computer.elapsedMillis(), rootMove, score, bestMoveNodeShare);
+        }
+
+        bool someSideIsCheckmating = std::abs(score) > MAX_EVAL;
+        if (someSideIsCheckmating) {
+            // root position is terminal node
+            break;
+        }
     }
+}
 
-    auto currPv = searchTable.find(task.rootPosition.board.getHash());
-    GenMove chosenMove = GenMove::NullMove();
-    if (currPv != searchTable.end()) {
-        chosenMove = currPv->second.pv;
+// searches the root with a narrow window around the last score, widening it whenever the score falls outside
+Score SearchWorker::aspirationSearch(Position& root, Score previousScore) {
+    if (completedDepth < ASPIRATION_MIN_DEPTH || std::abs(previousScore) > MAX_EVAL) {
+        return search(root, 0, iterativeDepth, -SCORE_CHECKMATE, SCORE_CHECKMATE);
     }
 
-    std::lock_guard<std::mutex> guard(outputLock);
-    bestMove.reset(new LanMove(chosenMove.toLanMove()));
+    int delta = ASPIRATION_WINDOW;
+    int alpha = std::max(previousScore - delta, -(int)SCORE_CHECKMATE);
+    int beta = std::min(previousScore + delta, (int)SCORE_CHECKMATE);
+
+    while (true) {
+        Score score = search(root, 0, iterativeDepth, alpha, beta);
+        if (stopped()) {
+            return score;
+        }
+
+        if (score <= alpha) {
+            // fail low, the window is shifted down as well so a collapsing score is found quickly
+            beta = (alpha + beta) / 2;
+            alpha = std::max(score - delta, -(int)SCORE_CHECKMATE);
+        } else if (score >= beta) {
+            beta = std::min(score + delta, (int)SCORE_CHECKMATE);
+        } else {
+            return score;
+        }
+        delta *= 2;
+    }
 }
 
-long SearchParams::getLongField(const char* key) const {
-    auto el = attributes.find(key);
-    if (el != attributes.end()) {
-        return el->second;
+Computer::Computer() {
+    setThreads(1);
+}
+
+void Computer::setThreads(int count) {
+    workers.clear();
+    for (int id = 0; id < count; id++) {
+        workers.emplace_back(new SearchWorker(*this, id));
     }
-    return -1;
 }
 
-bool SearchParams::getBoolField(const char* key) const {
-    long asLong = getLongField(key);
-    return asLong > 0;
+void Computer::searchReturned() {
+    {
+        std::lock_guard<std::mutex> guard(timerLock);
+        runningSearches--;
+    }
+    timerWakeup.notify_all();
+}
+
+void Computer::waitForSearch() {
+    std::unique_lock<std::mutex> lock(timerLock);
+    timerWakeup.wait(lock, [this] { return runningSearches == 0; });
+}
+
+/**
+ * Expects that a task has been set on the computer.
+ */
+
+void Computer::launchSearch() {
+    if (isWorking) {
+        return;
+    }
+
+    // ensures is working will always be turned off on return
+    ScopedWorkingGuard workingGuard(isWorking);
+
+    // the table is kept from the last move, its entries only lose priority for replacement
+    transpositionTable.newSearch();
+    timeManager.init(task.params, task.rootPosition.board.getSideToMove(), moveOverhead);
+    startTimer();
+
+    // lazy smp, helpers search the same tree and only communicate through the shared table
+    std::vector<std::thread> helpers;
+    for (size_t i = 1; i < workers.size(); i++) {
+        helpers.emplace_back(&SearchWorker::iterativeDeepening, workers[i].get());
+    }
+    workers[0]->iterativeDeepening();
+
+    // the main thread decides when the search ends
+    isWorking = false;
+    for (std::thread& helper : helpers) {
+        helper.join();
+    }
+    stopTimer();
+
+    // deepest completed iteration wins, ties go to the higher score
+    const SearchWorker* best = workers[0].get();
+    long evalCacheProbes = 0, evalCacheHits = 0;
+    for (const std::unique_ptr<SearchWorker>& worker : workers) {
+        if (worker->completedDepth > best->completedDepth ||
+            (worker->completedDepth == best->completedDepth && worker->rootScore > best->rootScore)) {
+            best = worker.get();
+        }
+        evalCacheProbes += worker->evalCacheProbes;
+        evalCacheHits += worker->evalCacheHits;
+    }
+    LanMove chosenMove = best->rootMove;
+    if (chosenMove.isNullMove()) {
+        // stopped before the first root move was searched, any legal move is better than none
+        MoveList legalMoves;
+        task.rootPosition.generateLegalMoves(legalMoves);
+        if (legalMoves.size > 0) {
+            chosenMove = legalMoves.list[0].toLanMove();
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(outputLock);
+    if (evalCacheProbes > 0) {
+        char evalCacheInfo[100];
+        sprintf(evalCacheInfo, "eval cache hit rate %.1f%% (%ld of %ld)",
+                100.0 * evalCacheHits / evalCacheProbes, evalCacheHits, evalCacheProbes);
+        infoStrings.push_back(evalCacheInfo);
+    }
+    bestMove.reset(new LanMove(chosenMove));
 }
 
@@ -2,102 +2,182 @@
 #include <array>
 #include <atomic>
 #include <chrono>
-#include <cstring>
+#include <condition_variable>
 #include <future>
 #include <iostream>
-#include <map>
 #include <memory>
 #include <mutex>
-#include <unordered_map>
+#include <thread>
 #include <vector>
 
 #include "board.h"
 #include "eval.h"
+#include "evalcache.h"
+#include "heuristics.h"
+#include "movepicker.h"
 #include "position.h"
 #include "nnue.h"
+#include "timeman.h"
+#include "tt.h"
 
 enum class ComputerTests {
     Perft,
     Zobrist,
 };
 
-struct StringComparator {
-    bool operator()(char const* a, char const* b) const {
-        return std::strcmp(a, b) < 0;
-    }
-};
-
-struct SearchParams {
-    std::map<const char*, long, StringComparator> attributes;
-    std::vector<LanMove> searchmoves;
-    
-    long getLongField(const char* key) const;
-    bool getBoolField(const char* key) const;
-    // long wtime, btime, winc, binc, movestogo, depth, nodes, mate, movetime;
-    // bool infinite, ponder;
-};
-
 struct ComputerInfo {
     long depth, score, nodes, nps;
     std::string pv;
 };
 
-// enum class SearchNodeType {
-//     Branch,
-//     Terminal,
-// };
-
-struct SearchNode {
-    GenMove pv;
-    Score score;
-    short knownDepth;
-};
-
 class ComputerSearchTask {
    public:
     Position rootPosition;
+    std::vector<U64> gameKeys;  // keys of the positions played before the root
     SearchParams params;
 
-    long currNodesSearched, prevTotalNodesSearched;
+    long prevTotalNodesSearched;
     std::chrono::_V2::system_clock::time_point lastTime, startTime;
-    int iterativeDepth;
 
     ComputerSearchTask() {}
 
     ComputerSearchTask(Position rootPosition) {
         this->rootPosition = rootPosition;
-        currNodesSearched = prevTotalNodesSearched = 0;
+        prevTotalNodesSearched = 0;
         lastTime = startTime = std::chrono::high_resolution_clock::now();
     }
 };
 
+class Computer;
+
+// half width of the first root window around the previous score, and the first iteration using one
+const int ASPIRATION_WINDOW = 25;
+const int ASPIRATION_MIN_DEPTH = 4;
+
+// forward pruning margins in centipawns per remaining ply
+const int RFP_MAX_DEPTH = 6;
+const int RFP_MARGIN = 80;
+const int FUTILITY_MAX_DEPTH = 3;
+const int FUTILITY_MARGIN = 120;
+const int NULL_MOVE_MIN_DEPTH = 3;
+const int LMR_MIN_DEPTH = 3;
+// quiescence captures are skipped if the stand pat plus the victim and this margin stay below alpha
+const int DELTA_MARGIN = 200;
+
+// late move reductions by remaining depth and number of moves searched before
+extern int lmrReductions[MAX_SEARCH_PLY][MAXIMUM_POSSIBLE_MOVES];
+void InitReductions();
+
+// search features which can be switched off with setoption, mainly for testing their strength
+struct SearchOptions {
+    bool nullMove = true;
+    bool reverseFutility = true;
+    bool futility = true;
+    bool lateMoveReductions = true;
+    bool deltaPruning = true;
+};
+
+// per ply state of a search thread, kept off the call stack
+struct SearchStackEntry {
+    UndoRecord undo;
+    MoveList moves;
+    GenMove move;  // move currently searched from this ply
+    GenMove quietsTried[MAX_QUIETS_TRIED];
+    int numQuietsTried;
+    int pliesSinceNull;  // plies played since the last null move of the line, the whole game without one
+};
+
+/**
+ * One thread of the lazy SMP search. Workers search the same root independently and only
+ * share the transposition table and eval cache, everything else is private to the thread.
+ */
+class SearchWorker {
+   public:
+    // result of the last completed iteration
+    int completedDepth;
+    Score rootScore;
+    LanMove rootMove;
+
+    // written only by the owning thread, read by the main thread for reporting
+    std::atomic<long> nodesSearched;
+    long evalCacheProbes, evalCacheHits;
+
+    SearchWorker(Computer& computer, int id);
+    void iterativeDeepening();
+
+   private:
+    Computer& computer;
+    int id;
+    int iterativeDepth;
+    LanMove currRootMove;
+    AccumulatorStack accumulators;
+    SearchStackEntry stack[MAX_SEARCH_PLY];
+    SearchHeuristics heuristics;
+    // keys of the positions before the current node, the game up to the root and then the search line
+    std::vector<U64> keyStack;
+    int rootKeyIndex;
+
+    long nodeLimit;
+    // nodes of the current root search and those spent below its best move, for the time manager
+    long rootSearchStartNodes, rootBestMoveNodes;
+
+    bool stopped() const;
+    void countNode();
+    bool isDraw(const Position& pos, int pliesSinceNull) const;
+    Score evaluate_relative(Board& board, int depth);
+    Score quiescence(Position& curr, int currentDepth, Score alpha, Score beta);
+    Score search(Position& curr, int currentDepth, int depth, Score alpha, Score beta);
+    Score aspirationSearch(Position& root, Score previousScore);
+};
+
 class Computer {
    public:
     std::atomic<bool> isWorking = false;
+    // searches started by the uci loop which have not returned yet, isWorking is already cleared when one is stopped
+    std::atomic<int> runningSearches = 0;
 
     ComputerSearchTask task;
+    EvalCache evalCache;
+    TranspositionTable transpositionTable;
+    SearchOptions options;
+    int moveOverhead = MOVE_OVERHEAD_DEFAULT;
 
     // needs to hold output lock to access info and bestmove
     std::mutex outputLock;
     std::vector<ComputerInfo> infoBuffer = {};
+    std::vector<std::string> infoStrings = {};
     std::unique_ptr<LanMove> bestMove = NULL;
 
+    Computer();
+    void setThreads(int count);
     void stopWorking();
     void launchTest(Position root, ComputerTests testType, int depth);
     void launchSearch();
+    // called by the thread of a search started by the uci loop once it has returned
+    void searchReturned();
+    void waitForSearch();
 
    private:
-    std::unordered_map<U64, SearchNode> searchTable;
-    AccumulatorStack accumulators;
+    std::vector<std::unique_ptr<SearchWorker>> workers;
+
+    TimeManager timeManager;
+    // stops the search at the hard time limit, so the workers only have to watch isWorking
+    std::thread timer;
+    // also wakes the uci loop waiting for runningSearches to drop to zero
+    std::mutex timerLock;
+    std::condition_variable timerWakeup;
+    bool searchDone;
 
-    Score evaluate_relative(Board& board, int depth);
     long perft(Position& curr, int depth);
     void launchPerft(Position& root, int depth);
     void launchZobrist(Position& root, int depth);
-    bool mustStopSearching();
-    Score quiescence(Position& curr, int currentDepth, Score alpha, Score beta);
-    Score search(Position& curr, int currentDepth, Score alpha, Score beta);
-    std::string getPvList(Position board);
-    void generateComputerInfo();
-    
-};
\ No newline at end of file
+    bool mustStopSearching(int iterativeDepth);
+    long elapsedMillis() const;
+    void startTimer();
+    void stopTimer();
+    long totalNodesSearched() const;
+    std::string getPvList(Position board, LanMove firstMove);
+    void generateComputerInfo(const SearchWorker& worker);
+
+    friend class SearchWorker;
+};
@@ -0,0 +1,37 @@
+#include "evalcache.h"
+
+const uint64_t KEY_MASK = ~0xFFFFULL;
+
+EvalCache::EvalCache() {
+    resize(EVAL_CACHE_DEFAULT_MB);
+}
+
+void EvalCache::resize(size_t megabytes) {
+    // round down to a power of two so the index is a mask of the hash
+    size_t count = 1;
+    while (2 * count * sizeof(uint64_t) <= megabytes * 1024 * 1024) {
+        count *= 2;
+    }
+    entries.reset(new std::atomic<uint64_t>[count]);
+    mask = count - 1;
+    clear();
+}
+
+void EvalCache::clear() {
+    for (size_t i = 0; i <= mask; i++) {
+        entries[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+bool EvalCache::probe(U64 hash, Score& score) const {
+    uint64_t entry = entries[hash & mask].load(std::memory_order_relaxed);
+    if ((entry & KEY_MASK) != (hash & KEY_MASK)) {
+        return false;
+    }
+    score = (Score)(uint16_t)entry;
+    return true;
+}
+
+void EvalCache::store(U64 hash, Score score) {
+    entries[hash & mask].store((hash & KEY_MASK) | (uint16_t)score, std::memory_order_relaxed);
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "eval.h"
+#include "labels.h"
+
+const int EVAL_CACHE_DEFAULT_MB = 16;
+
+/**
+ * Fixed size cache of static evaluations indexed by the zobrist hash. Each entry is one atomic
+ * word holding the upper 48 bits of the hash and the score, so it can be probed and written
+ * without a lock and an entry is never seen half written. Newer stores always overwrite.
+ */
+class EvalCache {
+   public:
+    EvalCache();
+    void resize(size_t megabytes);
+    void clear();
+    bool probe(U64 hash, Score& score) const;
+    void store(U64 hash, Score score);
+
+   private:
+    std::unique_ptr<std::atomic<uint64_t>[]> entries;
+    size_t mask;
+};
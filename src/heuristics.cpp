@@ -0,0 +1,59 @@
+#include "heuristics.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+// gravity update, values saturate towards the bounds instead of overflowing
+void updateHistory(int16_t& entry, int bonus) {
+    entry += bonus - entry * std::abs(bonus) / HISTORY_MAX;
+}
+
+void SearchHeuristics::clear() {
+    for (int ply = 0; ply < MAX_SEARCH_PLY; ply++) {
+        killers[ply][0] = killers[ply][1] = LanMove::NullMove();
+    }
+    std::fill(&butterfly[0][0][0], &butterfly[0][0][0] + 2 * 64 * 64, 0);
+    std::fill(&pieceTo[0][0], &pieceTo[0][0] + 12 * 64, 0);
+    std::fill(&counterMoves[0][0], &counterMoves[0][0] + 12 * 64, LanMove::NullMove());
+}
+
+// called between iterations, older results count less than the ones of the deeper search
+void SearchHeuristics::age() {
+    for (int16_t* h = &butterfly[0][0][0]; h < &butterfly[0][0][0] + 2 * 64 * 64; h++) {
+        *h /= 2;
+    }
+    for (int16_t* h = &pieceTo[0][0]; h < &pieceTo[0][0] + 12 * 64; h++) {
+        *h /= 2;
+    }
+}
+
+const LanMove* SearchHeuristics::getKillers(int ply) const {
+    return killers[ply];
+}
+
+LanMove SearchHeuristics::getCounterMove(const GenMove& previous) const {
+    return counterMoves[(int)previous.bb][previous.to];
+}
+
+int SearchHeuristics::getQuietScore(Side side, const GenMove& move) const {
+    return butterfly[(int)side][move.from][move.to] + pieceTo[(int)move.bb][move.to];
+}
+
+void SearchHeuristics::updateQuietCutoff(int ply, int depth, Side side, const GenMove& best, const GenMove* tried, int numTried, const GenMove* previous) {
+    LanMove bestLan = best.toLanMove();
+    if (!best.matchesLanMove(killers[ply][0])) {
+        killers[ply][1] = killers[ply][0];
+        killers[ply][0] = bestLan;
+    }
+    if (previous) {
+        counterMoves[(int)previous->bb][previous->to] = bestLan;
+    }
+
+    int bonus = std::min(depth * depth, 1200);
+    updateHistory(butterfly[(int)side][best.from][best.to], bonus);
+    updateHistory(pieceTo[(int)best.bb][best.to], bonus);
+    for (int i = 0; i < numTried; i++) {
+        updateHistory(butterfly[(int)side][tried[i].from][tried[i].to], -bonus);
+        updateHistory(pieceTo[(int)tried[i].bb][tried[i].to], -bonus);
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+
+#include "labels.h"
+#include "moves.h"
+
+// history values stay within [-HISTORY_MAX, HISTORY_MAX]
+const int HISTORY_MAX = 16384;
+const int MAX_QUIETS_TRIED = 64;
+
+/**
+ * Quiet move ordering knowledge of one search thread. Killers are the last two quiet moves which
+ * caused a beta cutoff at a ply, history scores every quiet move by how often it cut off before and
+ * the counter move table remembers which reply refuted the opponent's previous move.
+ */
+class SearchHeuristics {
+   public:
+    void clear();
+    void age();
+
+    const LanMove* getKillers(int ply) const;
+    LanMove getCounterMove(const GenMove& previous) const;
+    int getQuietScore(Side side, const GenMove& move) const;
+
+    // best is the quiet move which failed high, tried are the quiets searched before it without success
+    void updateQuietCutoff(int ply, int depth, Side side, const GenMove& best, const GenMove* tried, int numTried, const GenMove* previous);
+
+   private:
+    LanMove killers[MAX_SEARCH_PLY][2];
+    int16_t butterfly[2][64][64];  // side, from, to
+    int16_t pieceTo[12][64];       // moved piece, to
+    LanMove counterMoves[12][64];  // previous move's piece and target square
+};
@@ -3,21 +3,17 @@
 #include <cassert>
 #include <iostream>
 
-History::History() {
-    history.push_back(Position::startPos());
-}
+History::History() : History(Position::startPos()) {}
 
-History::History(Position startNode) {
-    history.push_back(startNode);
-}
+History::History(Position startNode) : position(startNode) {}
 
 bool History::tryMoveLan(LanMove lanMove) {
-    MoveList pseudoMoves;
-    current().board.generatePseudoMoves(pseudoMoves);
+    MoveList legalMoves;
+    position.board.generateMoves(legalMoves);
 
     GenMove correctMove = GenMove::NullMove();
 
-    for (GenMove genMove : pseudoMoves) {
+    for (GenMove genMove : legalMoves) {
         if (genMove.matchesLanMove(lanMove)) {
             correctMove = genMove;
             break;
@@ -25,30 +21,36 @@ bool History::tryMoveLan(LanMove lanMove) {
     }
 
     if (correctMove.isNullMove()) {
-        return false; // move was not in list
+        return false; // move was not in list, so it is illegal
     }
 
-    Position next(current());
-    next.movePseudoInPlace(correctMove);
-    if (!next.board.isLegal()) {
-        return false; // move is illegal
-    }
+    U64 key = position.board.getHash();
+    UndoRecord undo;
+    position.makeMove(correctMove, undo);
+
+    keys.push_back(key);
+    moves.push_back(correctMove);
+    undos.push_back(undo);
 
-    history.push_back(next);
-    
     return true;
 }
 
 void History::moveBack() {
-    history.pop_back();
+    assert(!moves.empty());
+    position.unmakeMove(moves.back(), undos.back());
+    keys.pop_back();
+    moves.pop_back();
+    undos.pop_back();
 }
 
 Position& History::current() {
-    assert(!history.empty());
-    return history.back();
+    return position;
 }
 
 const Position& History::current() const {
-    assert(!history.empty());
-    return history.back();
+    return position;
+}
+
+const std::vector<U64>& History::getKeys() const {
+    return keys;
 }
@@ -5,6 +5,10 @@
 #include "moves.h"
 #include "position.h"
 
+/**
+ * The game as played so far. Only the current position is kept in full, earlier positions are
+ * remembered by their zobrist keys for repetition detection and by undo records for moveBack.
+ */
 class History {
    public:
     History();
@@ -15,7 +19,12 @@ class History {
 
     const Position& current() const;
     Position& current();
+    // keys of all positions before the current one, oldest first
+    const std::vector<U64>& getKeys() const;
 
    private:
-    std::vector<Position> history;
-};
\ No newline at end of file
+    Position position;
+    std::vector<U64> keys;
+    std::vector<GenMove> moves;
+    std::vector<UndoRecord> undos;
+};
@@ -2,24 +2,27 @@
 #include <list>
 #include <string>
 
+#include "attacks.h"
 #include "hash.h"
 #include "log.h"
 #include "uci.h"
 #include "nnue.h"
 
-int main(/* int argc, char* argv[] */) {
+int main(int argc, char* argv[]) {
+    (void)argc;
     // IMPORTANT disable output buffering for both std::cout and printf
     std::cout.setf(std::ios::unitbuf);
     setvbuf(stdout, NULL, _IOLBF, 0);
 
     initLogging();
     InitZobrist();
+    InitAttacks();
+    InitReductions();
 
-    // std::string argv_str(argv[0]);
-    // std::string base = argv_str.substr(0, argv_str.find_last_of("/"));
-    // init_nnue(base + "/../weights/nnue_2025-02-27 17:18:02.625752.csv");
-
-    UCI uci;
+    // default network lives next to the repository, like the build output
+    std::string argv_str(argv[0]);
+    std::string base = argv_str.substr(0, argv_str.find_last_of("/") + 1);
+    UCI uci(base + "../weights/default.nnue");
 
     std::string input_buffer;
 
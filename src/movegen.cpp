@@ -1,90 +1,106 @@
+#include "attacks.h"
 #include "bitmath.h"
 #include "board.h"
 
-void Board::generatePseudoMoves(MoveList& moveList) {
-    useDerivedState();
+void Board::generateMoves(MoveList& moveList) {
+    generateMoves(moveList, MoveGenType::All);
+}
+
+void Board::generateMoves(MoveList& moveList, MoveGenType type) {
+    useMoveGenState();
+
+    // pawns differ from pieces as pushes onto the last rank are promotions and therefore noisy
+    U64 enemies = side == Side::White ? _blackPieces : _whitePieces;
+    U64 pieceTargets = ~0ULL, pawnTargets = ~0ULL;
+    if (type == MoveGenType::Noisy) {
+        pieceTargets = enemies;
+        pawnTargets = enemies | enpassantTarget | RANK_1 | RANK_8;
+    } else if (type == MoveGenType::Quiet) {
+        pieceTargets = ~_occupied;
+        pawnTargets = ~_occupied & ~enpassantTarget & ~RANK_1 & ~RANK_8;
+    }
 
-    genKnightMoves(moveList);
-    genKingMoves(moveList);
+    // in double check only the king can move
+    if (!_checkMask) {
+        genKingMoves(moveList, pieceTargets);
+        return;
+    }
+
+    genKnightMoves(moveList, pieceTargets);
+    genKingMoves(moveList, pieceTargets);
 
     if (side == Side::White) {
-        genMovesSlidingPieces(moveList, BitBoards::BW, false, true);
-        genMovesSlidingPieces(moveList, BitBoards::RW, true, false);
-        genMovesSlidingPieces(moveList, BitBoards::QW, true, true);
-        genPawnMovesWhite(moveList);
-        genCastlesWhite(moveList);
+        genMovesSlidingPieces(moveList, BitBoards::BW, false, true, pieceTargets);
+        genMovesSlidingPieces(moveList, BitBoards::RW, true, false, pieceTargets);
+        genMovesSlidingPieces(moveList, BitBoards::QW, true, true, pieceTargets);
+        genPawnMoves(moveList, pawnTargets);
+        if (type != MoveGenType::Noisy && !_checkers) genCastlesWhite(moveList);
     } else {
-        genMovesSlidingPieces(moveList, BitBoards::BB, false, true);
-        genMovesSlidingPieces(moveList, BitBoards::RB, true, false);
-        genMovesSlidingPieces(moveList, BitBoards::QB, true, true);
-        genPawnMovesBlack(moveList);
-        genCastlesBlack(moveList);
+        genMovesSlidingPieces(moveList, BitBoards::BB, false, true, pieceTargets);
+        genMovesSlidingPieces(moveList, BitBoards::RB, true, false, pieceTargets);
+        genMovesSlidingPieces(moveList, BitBoards::QB, true, true, pieceTargets);
+        genPawnMoves(moveList, pawnTargets);
+        if (type != MoveGenType::Noisy && !_checkers) genCastlesBlack(moveList);
     };
 }
 
-void Board::orderAndFilterMoveList(MoveList& moveList, const LanMove& pv, bool capturesOnly) const {
-
-    /**
-     * TODO: this could be sped up by directly taking the optimal move from an iterator automatically sorts and returns a reference. This would avoid copying
-     */
-
-    int numCaptures = 0;
-
-    // score all moves
-    for (GenMove& m : moveList) {
-        bool isCapture = m.capture == CaptureType::Capture;
-        if (isCapture) {
-            numCaptures++;
-        }
-
-        if (m.matchesLanMove(pv)) {
-            // PV
-            m.score = 0;
-        } else if (m.type == MoveTypes::Promote) {
-            // Promotion
-            m.score = 1;
-        } else if (isCapture) {
-            // Capture
-            m.score = 2;
-        } else {
-            // Other
-            m.score = 3;
-        }
-
-        if (capturesOnly && !isCapture) {
-            // overwrite other score since not capture here
-            m.score = 10;
+bool Board::findMove(const LanMove& lanMove, GenMove& move) {
+    if (lanMove.isNullMove()) {
+        return false;
+    }
+    useMoveGenState();
+
+    int offset = side == Side::White ? 0 : 6;
+    int bb = -1;
+    for (int i = offset; i < offset + 6; i++) {
+        if (boards[i] & (1ULL << lanMove.from)) {
+            bb = i;
+            break;
         }
     }
+    if (bb < 0) {
+        return false;
+    }
 
-    int sortSpace = capturesOnly ? numCaptures : moveList.size - 1;
-
-    // sort
-    for (int i = 0; i < sortSpace; i++) {
-
-        int minScore = moveList.list[i].score;
-        int minIndex = i;
-
-        for (int j = i + 1; j < moveList.size; j++) {
-            int currScore = moveList.list[j].score;
-            if (currScore < minScore) {
-                minScore = currScore;
-                minIndex = j;
+    // only moves of this piece type onto the target square are generated
+    MoveList candidates;
+    U64 targets = 1ULL << lanMove.to;
+    switch (bb - offset) {
+        case 0:
+            genPawnMoves(candidates, targets);
+            break;
+        case 1:
+            genMovesSlidingPieces(candidates, (BitBoards)bb, true, false, targets);
+            break;
+        case 2:
+            genKnightMoves(candidates, targets);
+            break;
+        case 3:
+            genMovesSlidingPieces(candidates, (BitBoards)bb, false, true, targets);
+            break;
+        case 4:
+            genMovesSlidingPieces(candidates, (BitBoards)bb, true, true, targets);
+            break;
+        case 5:
+            genKingMoves(candidates, targets);
+            if (_checkers) {
+                break;
             }
-        }
+            if (side == Side::White) {
+                genCastlesWhite(candidates);
+            } else {
+                genCastlesBlack(candidates);
+            }
+            break;
+    }
 
-        // swap
-        if (minIndex != i) {
-            GenMove temp = moveList.list[i];
-            moveList.list[i] = moveList.list[minIndex];
-            moveList.list[minIndex] = temp;
+    for (const GenMove& candidate : candidates) {
+        if (candidate.matchesLanMove(lanMove)) {
+            move = candidate;
+            return true;
         }
-    }    
-
-    // prune
-    if (capturesOnly) {
-        moveList.size = numCaptures;
     }
+    return false;
 }
 
 void Board::genCastlesWhite(MoveList& moveList) const {
@@ -121,10 +137,11 @@ void Board::genCastlesBlack(MoveList& moveList) const {
     }
 }
 
-void Board::genMovesSlidingPieces(MoveList& moveList, BitBoards bb, bool paral, bool diag) const {
+void Board::genMovesSlidingPieces(MoveList& moveList, BitBoards bb, bool paral, bool diag, U64 targets) const {
     const U64& validToSquares =
-        ~(side == Side::White ? _whitePieces : _blackPieces);
+        ~(side == Side::White ? _whitePieces : _blackPieces) & targets & _checkMask;
     U64 boardValue = boards[(int)bb];
+    int kingSquare = trailingZeros(boards[(int)(side == Side::White ? BitBoards::KW : BitBoards::KB)]);
 
     int i = 0;
     while (boardValue) {
@@ -133,147 +150,151 @@ void Board::genMovesSlidingPieces(MoveList& moveList, BitBoards bb, bool paral,
         // -> piece at i
         U64 moves = 0;
         // find all moves
-        if (paral) moves |= getHAndVMoves(i);
-        if (diag) moves |= getDandAntiDMoves(i);
-        // mask with board
+        if (paral) moves |= rookAttacks(i, _occupied);
+        if (diag) moves |= bishopAttacks(i, _occupied);
+        // mask with board, pinned pieces stay on the line through their king
         moves &= validToSquares;
+        if (_pinned & (1ULL << i)) moves &= LINE[kingSquare][i];
         // add to list
         addMovesFromBitboardSingle(moveList, moves, i, bb);
     }
 }
 
-void Board::genKingMoves(MoveList& moveList) const {
+void Board::genKingMoves(MoveList& moveList, U64 targets) const {
     bool isWhite = side == Side::White;
     BitBoards bb = isWhite ? BitBoards::KW : BitBoards::KB;
     U64 king = boards[(int)bb];
 
-    const U64& validForWhite = ~(_whitePieces | _unsafeForWhite);
-    const U64& validForBlack = ~(_blackPieces | _unsafeForBlack);
-    const U64& validToSquares = isWhite ? validForWhite : validForBlack;
+    U64 validToSquares = ~(isWhite ? _whitePieces | _unsafeForWhite : _blackPieces | _unsafeForBlack) & targets;
+
+    // the unsafe squares are found with the king on the board, so a checking slider also attacks the squares
+    // behind the king along its ray. Knights are never on a line with the king, pawns are excluded
+    U64 checkers = _checkers & ~boards[(int)(isWhite ? BitBoards::PB : BitBoards::PW)];
+    while (checkers && king) {
+        int i = trailingZeros(checkers);
+        checkers &= checkers - 1;
+        validToSquares &= ~(LINE[trailingZeros(king)][i] ^ (1ULL << i));
+    }
 
     while (king) {
         int i = trailingZeros(king);
         king ^= 1ULL << i;  // somehow necessary if multiple kings...
         // -> piece at i
-        int offset = i - SPAN_KING_OFFSET;
-        U64 moves = offset > 0 ? SPAN_KING << offset : SPAN_KING >> -offset;  // weird stuff happens when shifting by neg number
-        if (i % 8 < 4)
-            moves &= ~FILE_H;
-        else
-            moves &= ~FILE_A;
-        moves &= validToSquares;
+        U64 moves = KING_ATTACKS[i] & validToSquares;
         // add to list
         addMovesFromBitboardSingle(moveList, moves, i, bb);
     }
 }
 
-void Board::genKnightMoves(MoveList& moveList) const {
+void Board::genKnightMoves(MoveList& moveList, U64 targets) const {
     bool isWhite = side == Side::White;
     BitBoards bb = isWhite ? BitBoards::NW : BitBoards::NB;
-    U64 horse = boards[(int)bb];
+    U64 horse = boards[(int)bb] & ~_pinned;  // a pinned knight can never move along the pin
     const U64& validToSquares =
-        ~(isWhite ? _whitePieces : _blackPieces);
+        ~(isWhite ? _whitePieces : _blackPieces) & targets & _checkMask;
 
     int i = 0;
     while (horse) {
         i = trailingZeros(horse);
         horse ^= 1ULL << i;  // unset this bit
         // -> piece at i
-        int offset = i - SPAN_HORSE_OFFSET;
-        U64 moves = offset > 0 ? SPAN_HORSE << offset : SPAN_HORSE >> -offset;  // weird stuff happens when shifting by neg number
-        if (i % 8 < 4)
-            moves &= ~FILE_GH;
-        else
-            moves &= ~FILE_AB;
-
-        moves &= validToSquares;
+        U64 moves = KNIGHT_ATTACKS[i] & validToSquares;
         // add to list
         addMovesFromBitboardSingle(moveList, moves, i, bb);
     }
 }
 
-void Board::genPawnMovesWhite(MoveList& moveList) const {
-    const U64& pawns = boards[(int)BitBoards::PW];
+void Board::genPawnMoves(MoveList& moveList, U64 targets) const {
+    bool isWhite = side == Side::White;
+    U64 pawns = boards[(int)(isWhite ? BitBoards::PW : BitBoards::PB)];
+    int kingSquare = trailingZeros(boards[(int)(isWhite ? BitBoards::KW : BitBoards::KB)]);
+    // en passant is checked separately as the captured pawn is not on the target square
+    U64 legalTargets = targets & (_checkMask | enpassantTarget);
+
+    // all unpinned pawns at once, pinned ones one by one along their pin line
+    U64 pinned = pawns & _pinned;
+    if (isWhite) {
+        genPawnMovesWhite(moveList, pawns & ~pinned, legalTargets);
+    } else {
+        genPawnMovesBlack(moveList, pawns & ~pinned, legalTargets);
+    }
+    while (pinned) {
+        int i = trailingZeros(pinned);
+        pinned &= pinned - 1;
+        if (isWhite) {
+            genPawnMovesWhite(moveList, 1ULL << i, legalTargets & LINE[kingSquare][i]);
+        } else {
+            genPawnMovesBlack(moveList, 1ULL << i, legalTargets & LINE[kingSquare][i]);
+        }
+    }
+}
+
+void Board::genPawnMovesWhite(MoveList& moveList, U64 pawns, U64 targets) const {
     U64 pawnMoves;
     U64 empty = ~_occupied;
     // queenwards capture
-    pawnMoves = (pawns << 7) & ~FILE_H & ~RANK_8 & (_blackPieces | enpassantTarget);
+    pawnMoves = (pawns << 7) & ~FILE_H & ~RANK_8 & (_blackPieces | enpassantTarget) & targets;
     addMovesFromBitboardParallel(moveList, pawnMoves & ~enpassantTarget, 7, BitBoards::PW, MoveTypes::Normal);
-    addMovesFromBitboardParallel(moveList, pawnMoves & enpassantTarget, 7, BitBoards::PW, MoveTypes::EnpasQueen);
+    if ((pawnMoves & enpassantTarget) && isLegalEnpassant(trailingZeros(pawnMoves & enpassantTarget) - 7)) {
+        addMovesFromBitboardParallel(moveList, pawnMoves & enpassantTarget, 7, BitBoards::PW, MoveTypes::EnpasQueen);
+    }
     // kingwards capture
-    pawnMoves = (pawns << 9) & ~FILE_A & ~RANK_8 & (_blackPieces | enpassantTarget);
+    pawnMoves = (pawns << 9) & ~FILE_A & ~RANK_8 & (_blackPieces | enpassantTarget) & targets;
     addMovesFromBitboardParallel(moveList, pawnMoves & ~enpassantTarget, 9, BitBoards::PW, MoveTypes::Normal);
-    addMovesFromBitboardParallel(moveList, pawnMoves & enpassantTarget, 9, BitBoards::PW, MoveTypes::EnpasKing);
+    if ((pawnMoves & enpassantTarget) && isLegalEnpassant(trailingZeros(pawnMoves & enpassantTarget) - 9)) {
+        addMovesFromBitboardParallel(moveList, pawnMoves & enpassantTarget, 9, BitBoards::PW, MoveTypes::EnpasKing);
+    }
     // Forward one
-    pawnMoves = (pawns << 8) & ~RANK_8 & empty;
+    pawnMoves = (pawns << 8) & ~RANK_8 & empty & targets;
     addMovesFromBitboardParallel(moveList, pawnMoves, 8, BitBoards::PW, MoveTypes::Normal);
     // Forward two
-    pawnMoves = (((pawns << 8) & empty) << 8) & WHITE_SIDE & empty;
+    pawnMoves = (((pawns << 8) & empty) << 8) & WHITE_SIDE & empty & targets;
     addMovesFromBitboardParallel(moveList, pawnMoves, 16, BitBoards::PW, MoveTypes::PawnDouble);  // add move type
 
     // Promote diag left
-    pawnMoves = (pawns << 7) & ~FILE_H & RANK_8 & _blackPieces;
+    pawnMoves = (pawns << 7) & ~FILE_H & RANK_8 & _blackPieces & targets;
     addMovesFromBitboardParallelPromote(moveList, pawnMoves, 7, BitBoards::PW);
     // Promote diag right
-    pawnMoves = (pawns << 9) & ~FILE_A & RANK_8 & _blackPieces;
+    pawnMoves = (pawns << 9) & ~FILE_A & RANK_8 & _blackPieces & targets;
     addMovesFromBitboardParallelPromote(moveList, pawnMoves, 9, BitBoards::PW);
     // Promote forward
-    pawnMoves = (pawns << 8) & RANK_8 & empty;
+    pawnMoves = (pawns << 8) & RANK_8 & empty & targets;
     addMovesFromBitboardParallelPromote(moveList, pawnMoves, 8, BitBoards::PW);
 }
 
-void Board::genPawnMovesBlack(MoveList& moveList) const {
-    const U64& pawns = boards[(int)BitBoards::PB];
+void Board::genPawnMovesBlack(MoveList& moveList, U64 pawns, U64 targets) const {
     U64 pawnMoves;
     U64 empty = ~_occupied;
     // kingwards
-    pawnMoves = (pawns >> 7) & ~FILE_A & ~RANK_1 & (_whitePieces | enpassantTarget);
+    pawnMoves = (pawns >> 7) & ~FILE_A & ~RANK_1 & (_whitePieces | enpassantTarget) & targets;
     addMovesFromBitboardParallel(moveList, pawnMoves & ~enpassantTarget, -7, BitBoards::PB, MoveTypes::Normal);
-    addMovesFromBitboardParallel(moveList, pawnMoves & enpassantTarget, -7, BitBoards::PB, MoveTypes::EnpasKing);
+    if ((pawnMoves & enpassantTarget) && isLegalEnpassant(trailingZeros(pawnMoves & enpassantTarget) + 7)) {
+        addMovesFromBitboardParallel(moveList, pawnMoves & enpassantTarget, -7, BitBoards::PB, MoveTypes::EnpasKing);
+    }
     // queenwards
-    pawnMoves = (pawns >> 9) & ~FILE_H & ~RANK_1 & (_whitePieces | enpassantTarget);
+    pawnMoves = (pawns >> 9) & ~FILE_H & ~RANK_1 & (_whitePieces | enpassantTarget) & targets;
     addMovesFromBitboardParallel(moveList, pawnMoves & ~enpassantTarget, -9, BitBoards::PB, MoveTypes::Normal);
-    addMovesFromBitboardParallel(moveList, pawnMoves & enpassantTarget, -9, BitBoards::PB, MoveTypes::EnpasQueen);
+    if ((pawnMoves & enpassantTarget) && isLegalEnpassant(trailingZeros(pawnMoves & enpassantTarget) + 9)) {
+        addMovesFromBitboardParallel(moveList, pawnMoves & enpassantTarget, -9, BitBoards::PB, MoveTypes::EnpasQueen);
+    }
     // Forward one
-    pawnMoves = (pawns >> 8) & ~RANK_1 & empty;
+    pawnMoves = (pawns >> 8) & ~RANK_1 & empty & targets;
     addMovesFromBitboardParallel(moveList, pawnMoves, -8, BitBoards::PB, MoveTypes::Normal);
     // Forward two
-    pawnMoves = (((pawns >> 8) & empty) >> 8) & BLACK_SIDE & empty;
+    pawnMoves = (((pawns >> 8) & empty) >> 8) & BLACK_SIDE & empty & targets;
     addMovesFromBitboardParallel(moveList, pawnMoves, -16, BitBoards::PB, MoveTypes::PawnDouble);  // add move type
 
     // Promote diag left
-    pawnMoves = (pawns >> 7) & ~FILE_A & RANK_1 & _whitePieces;
+    pawnMoves = (pawns >> 7) & ~FILE_A & RANK_1 & _whitePieces & targets;
     addMovesFromBitboardParallelPromote(moveList, pawnMoves, -7, BitBoards::PB);
     // Promote diag right
-    pawnMoves = (pawns >> 9) & ~FILE_H & RANK_1 & _whitePieces;
+    pawnMoves = (pawns >> 9) & ~FILE_H & RANK_1 & _whitePieces & targets;
     addMovesFromBitboardParallelPromote(moveList, pawnMoves, -9, BitBoards::PB);
     // Promote forward
-    pawnMoves = (pawns >> 8) & RANK_1 & empty;
+    pawnMoves = (pawns >> 8) & RANK_1 & empty & targets;
     addMovesFromBitboardParallelPromote(moveList, pawnMoves, -8, BitBoards::PB);
 }
 
-// maybe use table for this part
-U64 Board::getHAndVMoves(int index) const {
-    U64 s = 1ULL << index;
-    int i = index % 8, j = index / 8;
-
-    // find all moves by magic
-    U64 horizontal = (_occupied - 2 * s) ^ reverse(reverse(_occupied) - 2 * reverse(s));
-    U64 vertical = ((_occupied & FILE_MASKS[i]) - 2 * s) ^ reverse(reverse(_occupied & FILE_MASKS[i]) - 2 * reverse(s));
-    return (horizontal & RANK_MASKS[j]) | (vertical & FILE_MASKS[i]);
-}
-
-U64 Board::getDandAntiDMoves(int index) const {
-    U64 s = 1ULL << index;
-    int d = (index / 8) + (index % 8);
-    int ad = (index / 8) + 7 - (index % 8);
-
-    // find all moves by magic
-    U64 diag = ((_occupied & DIAG_MASK[d]) - 2 * s) ^ reverse(reverse(_occupied & DIAG_MASK[d]) - 2 * reverse(s));
-    U64 antiDiag = ((_occupied & ANTIDIAG_MASK[ad]) - 2 * s) ^ reverse(reverse(_occupied & ANTIDIAG_MASK[ad]) - 2 * reverse(s));
-    return (diag & DIAG_MASK[d]) | (antiDiag & ANTIDIAG_MASK[ad]);
-}
-
 void Board::addMovesFromBitboardSingle(MoveList& moves, U64 destinations, int position, BitBoards bb) const {
     int i = 0;
     while (destinations) {
@@ -305,7 +326,8 @@ void Board::addMovesFromBitboardParallel(MoveList& moves, U64 destinations, int
         i = trailingZeros(destinations);
         U64 hot = 1ULL << i;
         destinations ^= hot;  // unset this bit
-        CaptureType cap = hot & _occupied ? CaptureType::Capture : CaptureType::NonCapture;
+        // en passant captures land on an empty square
+        CaptureType cap = hot & (_occupied | enpassantTarget) ? CaptureType::Capture : CaptureType::NonCapture;
         moves.add(GenMove(i - offset, i, MovePromotions::None, bb, type, cap));
     }
 }
@@ -0,0 +1,162 @@
+#include "movepicker.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "eval.h"
+
+bool sameMove(const LanMove& a, const LanMove& b) {
+    return a.from == b.from && a.to == b.to && a.promotion == b.promotion;
+}
+
+MovePicker::MovePicker(Board& board, MoveList& moves, const LanMove& ttMove, const SearchHeuristics& heuristics, int ply, const GenMove* previous)
+    : board(board), moves(moves), stage(PickerStage::TTMove), noisyOnly(false), ttMove(ttMove), heuristics(&heuristics) {
+    const LanMove* killers = heuristics.getKillers(ply);
+    refutations[0] = killers[0];
+    refutations[1] = killers[1];
+    refutations[2] = previous ? heuristics.getCounterMove(*previous) : LanMove::NullMove();
+    moves.size = 0;
+}
+
+MovePicker::MovePicker(Board& board, MoveList& moves)
+    : board(board), moves(moves), stage(PickerStage::GenerateNoisy), noisyOnly(true) {
+    moves.size = 0;
+}
+
+bool MovePicker::next(GenMove& move) {
+    switch (stage) {
+        case PickerStage::TTMove:
+            stage = PickerStage::GenerateNoisy;
+            // table entries only verify part of the hash, so the move must be checked on this board
+            if (board.findMove(ttMove, move)) {
+                return true;
+            }
+            [[fallthrough]];
+
+        case PickerStage::GenerateNoisy:
+            board.generateMoves(moves, MoveGenType::Noisy);
+            scoreNoisy();
+            stage = PickerStage::Noisy;
+            [[fallthrough]];
+
+        case PickerStage::Noisy:
+            while (pickBest(move)) {
+                if (move.matchesLanMove(ttMove)) {
+                    continue;
+                }
+                // underpromotions are not worth resolving in quiescence
+                if (noisyOnly && move.capture == CaptureType::NonCapture && move.promotion != MovePromotions::Q) {
+                    continue;
+                }
+                if (!board.see(move, 0)) {
+                    // the slot was already picked, so it can hold the move until the quiets are done
+                    if (!noisyOnly) {
+                        moves.list[numBadNoisy++] = move;
+                    }
+                    continue;
+                }
+                return true;
+            }
+            if (noisyOnly) {
+                stage = PickerStage::Done;
+                return false;
+            }
+            stage = PickerStage::Refutations;
+            [[fallthrough]];
+
+        case PickerStage::Refutations:
+            while (refutationIndex < 3) {
+                int index = refutationIndex++;
+                const LanMove& refutation = refutations[index];
+                if (refutation.isNullMove() || sameMove(refutation, ttMove)) {
+                    continue;
+                }
+                // the counter move may equal a killer
+                if (index == 2 && (sameMove(refutation, refutations[0]) || sameMove(refutation, refutations[1]))) {
+                    continue;
+                }
+                // a refutation from another node may be a capture or impossible here
+                if (board.findMove(refutation, move) && move.capture == CaptureType::NonCapture && move.type != MoveTypes::Promote) {
+                    return true;
+                }
+            }
+            stage = PickerStage::GenerateQuiet;
+            [[fallthrough]];
+
+        case PickerStage::GenerateQuiet:
+            // noisy moves are all picked, so their slots are reused behind the losing ones
+            moves.size = numBadNoisy;
+            current = numBadNoisy;
+            board.generateMoves(moves, MoveGenType::Quiet);
+            scoreQuiets();
+            stage = PickerStage::Quiet;
+            [[fallthrough]];
+
+        case PickerStage::Quiet:
+            while (pickBest(move)) {
+                if (!isSpecial(move)) {
+                    return true;
+                }
+            }
+            stage = PickerStage::BadNoisy;
+            [[fallthrough]];
+
+        case PickerStage::BadNoisy:
+            if (badNoisyIndex < numBadNoisy) {
+                move = moves.list[badNoisyIndex++];
+                return true;
+            }
+            stage = PickerStage::Done;
+            [[fallthrough]];
+
+        case PickerStage::Done:
+            return false;
+    }
+    return false;
+}
+
+// most valuable victim, least valuable attacker
+void MovePicker::scoreNoisy() {
+    for (GenMove& m : moves) {
+        m.score = 0;
+        if (m.capture == CaptureType::Capture) {
+            // en passant captures a pawn on an empty square
+            int victim = std::max(board.getPieceOn(m.to), 0) % 6;
+            m.score = 16 * PIECE_VALUES[victim] - PIECE_VALUES[(int)m.bb % 6];
+        }
+        if (m.promotion == MovePromotions::Q) {
+            m.score += 16 * PIECE_VALUES[4];
+        } else if (m.promotion != MovePromotions::None) {
+            m.score -= 16 * PIECE_VALUES[4];
+        }
+    }
+}
+
+void MovePicker::scoreQuiets() {
+    Side side = board.getSideToMove();
+    for (GenMove& m : moves) {
+        m.score = heuristics->getQuietScore(side, m);
+    }
+}
+
+// selection of the best remaining move, the list is only sorted as far as moves are taken
+bool MovePicker::pickBest(GenMove& move) {
+    if (current >= moves.size) {
+        return false;
+    }
+    int bestIndex = current;
+    for (int i = current + 1; i < moves.size; i++) {
+        if (moves.list[i].score > moves.list[bestIndex].score) {
+            bestIndex = i;
+        }
+    }
+    std::swap(moves.list[current], moves.list[bestIndex]);
+    move = moves.list[current++];
+    return true;
+}
+
+// moves which were already handed out before the quiets were generated
+bool MovePicker::isSpecial(const GenMove& move) const {
+    return move.matchesLanMove(ttMove) || move.matchesLanMove(refutations[0]) ||
+           move.matchesLanMove(refutations[1]) || move.matchesLanMove(refutations[2]);
+}
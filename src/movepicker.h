@@ -0,0 +1,49 @@
+#pragma once
+#include "board.h"
+#include "heuristics.h"
+#include "moves.h"
+
+enum class PickerStage {
+    TTMove,
+    GenerateNoisy,
+    Noisy,
+    Refutations,
+    GenerateQuiet,
+    Quiet,
+    BadNoisy,
+    Done,
+};
+
+/**
+ * Hands out the moves of a node one at a time, most promising first. Only the work needed for the
+ * moves actually taken is done: the TT move is tried before anything is generated, captures and
+ * quiets are generated when their stage is reached and every pick only selects the best remaining move.
+ * Captures which lose material by static exchange evaluation are tried after the quiets, quiescence drops them.
+ */
+class MovePicker {
+   public:
+    // main search, quiets are ordered by the history of the heuristics
+    MovePicker(Board& board, MoveList& moves, const LanMove& ttMove, const SearchHeuristics& heuristics, int ply, const GenMove* previous);
+    // quiescence search, only captures and queen promotions which do not lose material
+    MovePicker(Board& board, MoveList& moves);
+
+    bool next(GenMove& move);
+
+   private:
+    Board& board;
+    MoveList& moves;
+    PickerStage stage;
+    bool noisyOnly;
+    LanMove ttMove;
+    const SearchHeuristics* heuristics = nullptr;
+    LanMove refutations[3];  // two killers and the counter move
+    int refutationIndex = 0;
+    int current = 0;  // next unpicked index into moves
+    int numBadNoisy = 0;  // losing noisy moves, kept at the front of moves
+    int badNoisyIndex = 0;
+
+    void scoreNoisy();
+    void scoreQuiets();
+    bool pickBest(GenMove& move);
+    bool isSpecial(const GenMove& move) const;
+};
@@ -1,25 +1,62 @@
 #include "nnue.h"
 
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <cassert>
 #include <cstring>
 
 #include "bitmath.h"
+#include "nnue_kernels.h"
 
-// const int QA = 255;
-// const int QB = 128;
+static_assert(sizeof(NetworkFileHeader) == 64);
 
-int get_input_index(bool flipped, int bb, int square) {
-    if (flipped) {
+// the best kernels this cpu can run, the rest of the binary may be built for an older baseline
+static const NnueKernels* select_kernels() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();  // runs before main
+    if (__builtin_cpu_supports("x86-64-v4")) return &NNUE_KERNELS_AVX512;
+    if (__builtin_cpu_supports("x86-64-v3")) return &NNUE_KERNELS_AVX2;
+    if (__builtin_cpu_supports("x86-64-v2")) return &NNUE_KERNELS_SSE41;
+#endif
+    return &NNUE_KERNELS_SCALAR;
+}
+
+static const NnueKernels* kernels = select_kernels();
+static const QuantizedNetwork* network = nullptr;
+static void* mapped_file = nullptr;
+static size_t mapped_size = 0;
+
+int get_king_bucket(Side perspective, int kingSquare) {
+    if (perspective == Side::Black) {
+        kingSquare ^= 0b111000;
+    }
+    return KING_BUCKETS[kingSquare];
+}
+
+int get_king_square(Side perspective, const U64* boards) {
+    return trailingZeros(boards[(int)(perspective == Side::White ? BitBoards::KW : BitBoards::KB)]);
+}
+
+int get_input_index(Side perspective, int kingSquare, int bb, int square) {
+    if (perspective == Side::Black) {
         // switch colors
         bb = (bb + 6) % 12;
         // flip vertically
         square ^= 0b111000;
     }
-    return 64 * bb + square;
+    return 768 * get_king_bucket(perspective, kingSquare) + 64 * bb + square;
+}
+
+int get_output_bucket(U64 occupied) {
+    int num_pieces = countBits(occupied);
+    int output_bucket = int((num_pieces - 2) / (31.0f / (float)NUM_BUCKETS));
+    return std::min(output_bucket, NUM_BUCKETS - 1);
 }
 
 float SCReLU(float x) {
@@ -32,102 +69,357 @@ float SCReLU(float x) {
     return x * x;
 }
 
-void Accumulator::init() {
-    for (int i = 0; i < HL_SIZE; i++) {
-        white_acc[i] = nnue_accumulator_biases[i];
-        black_acc[i] = nnue_accumulator_biases[i];
+bool load_nnue(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        printf("ERROR could not open network file \"%s\"\n", path.c_str());
+        return false;
     }
+    struct stat fileStat;
+    size_t expectedSize = sizeof(NetworkFileHeader) + sizeof(QuantizedNetwork);
+    if (fstat(fd, &fileStat) < 0 || (size_t)fileStat.st_size != expectedSize) {
+        printf("ERROR network file \"%s\" has wrong size, expected %zu bytes\n", path.c_str(), expectedSize);
+        close(fd);
+        return false;
+    }
+    // shared read-only mapping, the kernel keeps one copy in the page cache for all processes
+    void* mapping = mmap(nullptr, expectedSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        printf("ERROR could not map network file \"%s\"\n", path.c_str());
+        return false;
+    }
+
+    const NetworkFileHeader* header = (const NetworkFileHeader*)mapping;
+    bool valid = std::memcmp(header->magic, NNUE_FILE_MAGIC, sizeof(NNUE_FILE_MAGIC)) == 0 &&
+                 header->version == NNUE_FILE_VERSION &&
+                 header->input_size == INPUT_SIZE && header->hl_size == HL_SIZE && header->num_buckets == NUM_BUCKETS &&
+                 header->num_king_buckets == NUM_KING_BUCKETS &&
+                 header->qa == QA && header->qb == QB && header->screlu_shift == SCRELU_SHIFT;
+    if (!valid) {
+        printf("ERROR network file \"%s\" is not a version %u network with matching architecture\n", path.c_str(), NNUE_FILE_VERSION);
+        munmap(mapping, expectedSize);
+        return false;
+    }
+    madvise(mapping, expectedSize, MADV_WILLNEED);
+
+    if (mapped_file) {
+        munmap(mapped_file, mapped_size);
+    }
+    mapped_file = mapping;
+    mapped_size = expectedSize;
+    network = (const QuantizedNetwork*)((const char*)mapping + sizeof(NetworkFileHeader));
+    return true;
 }
 
-void Accumulator::add(int bb, int square) {
-    int white_input_index = get_input_index(false, bb, square);
-    int black_input_index = get_input_index(true, bb, square);
-    for (int i = 0; i < HL_SIZE; i++) {
-        white_acc[i] += nnue_accumulator_weights[white_input_index][i];
-        black_acc[i] += nnue_accumulator_weights[black_input_index][i];
+bool nnue_loaded() {
+    return network != nullptr;
+}
+
+const char* nnue_simd_name() {
+    return kernels->name;
+}
+
+void Accumulator::refresh(Side perspective, const U64* boards) {
+    int16_t* acc = values[(int)perspective];
+    int kingSquare = get_king_square(perspective, boards);
+    std::memcpy(acc, network->accumulator_biases, sizeof(values[0]));
+    for (int piece = 0; piece < 12; piece++) {
+        U64 bb = boards[piece];
+        while (bb) {
+            int square = trailingZeros(bb);
+            bb ^= 1ULL << square;
+            kernels->add_weights(acc, network->accumulator_weights[get_input_index(perspective, kingSquare, piece, square)]);
+        }
     }
 }
 
-void Accumulator::remove(int bb, int square) {
-    int white_input_index = get_input_index(false, bb, square);
-    int black_input_index = get_input_index(true, bb, square);
-    for (int i = 0; i < HL_SIZE; i++) {
-        white_acc[i] -= nnue_accumulator_weights[white_input_index][i];
-        black_acc[i] -= nnue_accumulator_weights[black_input_index][i];
+void Accumulator::update(const Accumulator& parent, Side perspective, int kingSquare, const BoardEditRecorder& recorder) {
+    const int16_t* adds[MAX_BOARD_EDITS_PER_MOVE];
+    const int16_t* subs[MAX_BOARD_EDITS_PER_MOVE];
+    int numAdds = 0, numSubs = 0;
+
+    for (int i = 0; i < recorder.numEdits; i++) {
+        const BoardEdit& edit = recorder.edits[i];
+        // edits that undo each other (pawn placed and removed again on promotion) cost nothing
+        bool cancelled = false;
+        for (int j = 0; j < recorder.numEdits; j++) {
+            const BoardEdit& other = recorder.edits[j];
+            if (other.type != edit.type && other.bb == edit.bb && other.square == edit.square) {
+                cancelled = true;
+                break;
+            }
+        }
+        if (cancelled) {
+            continue;
+        }
+        const int16_t* row = network->accumulator_weights[get_input_index(perspective, kingSquare, edit.bb, edit.square)];
+        if (edit.type == BoardEditType::Add) {
+            adds[numAdds++] = row;
+        } else {
+            subs[numSubs++] = row;
+        }
     }
+
+    int p = (int)perspective;
+    kernels->update_weights(values[p], parent.values[p], adds, numAdds, subs, numSubs);
 }
 
 int32_t Accumulator::forward(Side side, U64 occupied) const {
-    // CONCATENATE AND OUTPUT
-    int white_start = 0;
-    int black_start = HL_SIZE;
-    if (side == Side::Black) {
-        // concatenate in reverse
-        white_start = HL_SIZE;
-        black_start = 0;
+    // CONCATENATE AND OUTPUT, side to move first
+    const int16_t* stm_acc = values[(int)side];
+    const int16_t* nstm_acc = values[(int)side ^ 1];
+
+    int output_bucket = get_output_bucket(occupied);
+    const int16_t* weights = network->output_weights[output_bucket];
+
+    int32_t output = network->output_bias[output_bucket];
+    output += kernels->screlu_dot(stm_acc, weights);
+    output += kernels->screlu_dot(nstm_acc, weights + HL_SIZE);
+
+    return output / OUTPUT_SCALE;
+}
+
+void RefreshCache::init() {
+    for (int p = 0; p < 2; p++) {
+        for (int b = 0; b < NUM_KING_BUCKETS; b++) {
+            // start from the empty board
+            std::memcpy(entries[p][b].values, network->accumulator_biases, sizeof(entries[p][b].values));
+            std::memset(entries[p][b].boards, 0, sizeof(entries[p][b].boards));
+        }
     }
+}
 
-    int num_pieces = countBits(occupied);
-    int output_bucket = int((num_pieces - 2) / (31.0f / (float)NUM_BUCKETS));
-    output_bucket = std::min(output_bucket, NUM_BUCKETS - 1);
+void RefreshCache::refresh(Accumulator& acc, Side perspective, const U64* boards) {
+    int kingSquare = get_king_square(perspective, boards);
+    RefreshCacheEntry& entry = entries[(int)perspective][get_king_bucket(perspective, kingSquare)];
+
+    // both boards hold at most 32 pieces
+    const int16_t* adds[32];
+    const int16_t* subs[32];
+    int numAdds = 0, numSubs = 0;
 
-    float output = 0;
+    for (int piece = 0; piece < 12; piece++) {
+        U64 added = boards[piece] & ~entry.boards[piece];
+        U64 removed = entry.boards[piece] & ~boards[piece];
+        while (added) {
+            int square = trailingZeros(added);
+            added ^= 1ULL << square;
+            assert(numAdds < 32);
+            adds[numAdds++] = network->accumulator_weights[get_input_index(perspective, kingSquare, piece, square)];
+        }
+        while (removed) {
+            int square = trailingZeros(removed);
+            removed ^= 1ULL << square;
+            assert(numSubs < 32);
+            subs[numSubs++] = network->accumulator_weights[get_input_index(perspective, kingSquare, piece, square)];
+        }
+        entry.boards[piece] = boards[piece];
+    }
+    kernels->update_weights(entry.values, entry.values, adds, numAdds, subs, numSubs);
+
+    std::memcpy(acc.values[(int)perspective], entry.values, sizeof(entry.values));
+}
+
+float nnue_reference_eval(const Board& board) {
+    float white_acc[HL_SIZE];
+    float black_acc[HL_SIZE];
     for (int i = 0; i < HL_SIZE; i++) {
-        output += SCReLU(white_acc[i]) * nnue_output_weights[output_bucket][white_start + i];
-        output += SCReLU(black_acc[i]) * nnue_output_weights[output_bucket][black_start + i];
+        white_acc[i] = network->accumulator_biases[i] / (float)QA;
+        black_acc[i] = network->accumulator_biases[i] / (float)QA;
     }
+    U64 boards[12];
+    for (int piece = 0; piece < 12; piece++) {
+        boards[piece] = board.getBoard((BitBoards)piece);
+    }
+    int white_king = get_king_square(Side::White, boards);
+    int black_king = get_king_square(Side::Black, boards);
+    for (int piece = 0; piece < 12; piece++) {
+        U64 bb = boards[piece];
+        while (bb) {
+            int square = trailingZeros(bb);
+            bb ^= 1ULL << square;
+            int white_input_index = get_input_index(Side::White, white_king, piece, square);
+            int black_input_index = get_input_index(Side::Black, black_king, piece, square);
+            for (int i = 0; i < HL_SIZE; i++) {
+                white_acc[i] += network->accumulator_weights[white_input_index][i] / (float)QA;
+                black_acc[i] += network->accumulator_weights[black_input_index][i] / (float)QA;
+            }
+        }
+    }
+
+    const float* stm_acc = board.getSideToMove() == Side::White ? white_acc : black_acc;
+    const float* nstm_acc = board.getSideToMove() == Side::White ? black_acc : white_acc;
 
-    return (int)output;
+    U64 occupied = 0;
+    for (int piece = 0; piece < 12; piece++) {
+        occupied |= board.getBoard((BitBoards)piece);
+    }
+    int output_bucket = get_output_bucket(occupied);
+    const int16_t* weights = network->output_weights[output_bucket];
+
+    float output = network->output_bias[output_bucket] / (float)OUTPUT_SCALE;
+    for (int i = 0; i < HL_SIZE; i++) {
+        output += SCReLU(stm_acc[i]) * weights[i] / (float)QB;
+        output += SCReLU(nstm_acc[i]) * weights[HL_SIZE + i] / (float)QB;
+    }
+    return output;
+}
+
+int32_t nnue_eval(const Board& board) {
+    U64 boards[12];
+    U64 occupied = 0;
+    for (int piece = 0; piece < 12; piece++) {
+        boards[piece] = board.getBoard((BitBoards)piece);
+        occupied |= boards[piece];
+    }
+    Accumulator acc;
+    acc.refresh(Side::White, boards);
+    acc.refresh(Side::Black, boards);
+    return acc.forward(board.getSideToMove(), occupied);
+}
+
+struct alignas(64) BatchActivation {
+    int16_t values[2 * HL_SIZE];  // side to move first
+};
+
+void nnue_eval_batch(const std::vector<Board>& boards, std::vector<int32_t>& evals) {
+    evals.resize(boards.size());
+    std::vector<BatchActivation> activations(NNUE_BATCH_SIZE);
+    alignas(64) int16_t acc[HL_SIZE];
+    int buckets[NNUE_BATCH_SIZE];
+
+    for (size_t start = 0; start < boards.size(); start += NNUE_BATCH_SIZE) {
+        int count = (int)std::min((size_t)NNUE_BATCH_SIZE, boards.size() - start);
+
+        // accumulators from the biases and all gathered rows in one pass, then activate
+        for (int i = 0; i < count; i++) {
+            const Board& board = boards[start + i];
+            U64 pieces[12];
+            U64 occupied = 0;
+            for (int piece = 0; piece < 12; piece++) {
+                pieces[piece] = board.getBoard((BitBoards)piece);
+                occupied |= pieces[piece];
+            }
+            buckets[i] = get_output_bucket(occupied);
+
+            for (Side perspective : {Side::White, Side::Black}) {
+                const int16_t* rows[32];
+                int numRows = 0;
+                int kingSquare = get_king_square(perspective, pieces);
+                for (int piece = 0; piece < 12; piece++) {
+                    U64 bb = pieces[piece];
+                    while (bb) {
+                        int square = trailingZeros(bb);
+                        bb ^= 1ULL << square;
+                        assert(numRows < 32);
+                        rows[numRows++] = network->accumulator_weights[get_input_index(perspective, kingSquare, piece, square)];
+                    }
+                }
+                kernels->update_weights(acc, network->accumulator_biases, rows, numRows, nullptr, 0);
+                int offset = perspective == board.getSideToMove() ? 0 : HL_SIZE;
+                kernels->screlu_activate(activations[i].values + offset, acc);
+            }
+        }
+
+        // output layer as a matrix product, positions sharing a bucket share the weight row
+        for (int b = 0; b < NUM_BUCKETS; b++) {
+            int indices[NNUE_BATCH_SIZE];
+            int numIndices = 0;
+            for (int i = 0; i < count; i++) {
+                if (buckets[i] == b) {
+                    indices[numIndices++] = i;
+                }
+            }
+            for (int k = 0; k < numIndices; k += NNUE_OUTPUT_TILE) {
+                int tile = std::min(NNUE_OUTPUT_TILE, numIndices - k);
+                const int16_t* tileActivations[NNUE_OUTPUT_TILE];
+                int32_t sums[NNUE_OUTPUT_TILE];
+                for (int t = 0; t < tile; t++) {
+                    tileActivations[t] = activations[indices[k + t]].values;
+                }
+                kernels->output_tile(tileActivations, network->output_weights[b], sums, tile);
+                for (int t = 0; t < tile; t++) {
+                    evals[start + indices[k + t]] = (network->output_bias[b] + sums[t]) / OUTPUT_SCALE;
+                }
+            }
+        }
+    }
 }
 
 // assumes ply is in bounds
-void AccumulatorStack::stackUp(int ply) {
+void AccumulatorStack::syncBoards(int ply) {
     AccumulatorStackNode& node = stack[ply];
-    if (!node.dirty) {
+    if (!node.boardsDirty) {
         return;
     }
-    stackUp(ply - 1);
+    syncBoards(ply - 1);
     AccumulatorStackNode& parent = stack[ply - 1];
-    assert(!parent.dirty);
-
-    // copy (TODO check if there is other option)
-    node.acc = parent.acc;
 
-    assert(node.recorder.numEdits);  // assume moves always change something on the board
-    // apply recorded edits
+    // a null move records no edits and simply copies the parent
+    std::memcpy(node.boards, parent.boards, sizeof(node.boards));
     for (int i = 0; i < node.recorder.numEdits; i++) {
         BoardEdit& edit = node.recorder.edits[i];
         if (edit.type == BoardEditType::Add) {
-            node.acc.add(edit.bb, edit.square);
+            node.boards[edit.bb] |= 1ULL << edit.square;
         } else {
-            node.acc.remove(edit.bb, edit.square);
+            node.boards[edit.bb] &= ~(1ULL << edit.square);
         }
     }
+    node.boardsDirty = false;
+}
 
-    node.recorder.clear();
-    node.dirty = false;
+bool AccumulatorStack::kingBucketChanged(int ply, Side perspective) const {
+    int kingSquare = get_king_square(perspective, stack[ply].boards);
+    int parentKingSquare = get_king_square(perspective, stack[ply - 1].boards);
+    return get_king_bucket(perspective, kingSquare) != get_king_bucket(perspective, parentKingSquare);
+}
+
+void AccumulatorStack::materialize(int ply, Side perspective) {
+    int p = (int)perspective;
+    if (!stack[ply].dirty[p]) {
+        return;
+    }
+    syncBoards(ply);
+
+    // walk back to the nearest ancestor which has this perspective computed, or which must
+    // refresh it anyway because the king changed bucket. Everything before that is never needed.
+    int start = ply;
+    while (stack[start].dirty[p] && !kingBucketChanged(start, perspective)) {
+        start--;
+    }
+    if (stack[start].dirty[p]) {
+        // features of every piece change, start from the cached accumulator of the new bucket
+        refreshCache.refresh(stack[start].acc, perspective, stack[start].boards);
+        stack[start].dirty[p] = false;
+    }
+
+    for (int i = start + 1; i <= ply; i++) {
+        AccumulatorStackNode& node = stack[i];
+        // parent is read once and all recorded edits are applied on the way into this node
+        int kingSquare = get_king_square(perspective, node.boards);
+        node.acc.update(stack[i - 1].acc, perspective, kingSquare, node.recorder);
+        node.dirty[p] = false;
+    }
 }
 
 void AccumulatorStack::init(const Board& board) {
     AccumulatorStackNode& root = stack[0];
-    root.dirty = false;
+    root.boardsDirty = root.dirty[0] = root.dirty[1] = false;
     root.recorder.clear();
 
-    root.acc.init();
-
     for (int piece = 0; piece < 12; piece++) {
-        U64 bb = board.getBoard((BitBoards)piece);
-        while (bb) {
-            int square = trailingZeros(bb);
-            bb ^= 1ULL << square;
-            root.acc.add(piece, square);
-        }
+        root.boards[piece] = board.getBoard((BitBoards)piece);
     }
+    refreshCache.init();
+    refreshCache.refresh(root.acc, Side::White, root.boards);
+    refreshCache.refresh(root.acc, Side::Black, root.boards);
 }
 
 int32_t AccumulatorStack::forward(int ply, Side side, U64 occupied) {
     assert(ply < ACCUMULATOR_MAX_DEPTH);
-    stackUp(ply);
+    materialize(ply, Side::White);
+    materialize(ply, Side::Black);
     AccumulatorStackNode& node = stack[ply];
     return node.acc.forward(side, occupied);
 }
@@ -143,5 +435,5 @@ void AccumulatorStack::markDirty(int ply) {
     assert(1 <= ply);
     assert(ply < ACCUMULATOR_MAX_DEPTH);
     AccumulatorStackNode& node = stack[ply];
-    node.dirty = true;
+    node.boardsDirty = node.dirty[0] = node.dirty[1] = true;
 }
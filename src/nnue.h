@@ -1,42 +1,116 @@
 #pragma once
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include "board.h"
 #include "labels.h"
 
 // partially from: https://www.chessprogramming.org/NNUE
 
-const int INPUT_SIZE = 768;
+// inputs are 768 piece-square features per king bucket of the perspective's own king (HalfKA-style)
+const int NUM_KING_BUCKETS = 4;
+const int INPUT_SIZE = 768 * NUM_KING_BUCKETS;
 const int HL_SIZE = 1024;
 const int NUM_BUCKETS = 8;
 
-/**
- * Will be linked to asm file of weights created by python script
- */
-extern const float nnue_accumulator_weights[INPUT_SIZE][HL_SIZE];
-extern const float nnue_accumulator_biases[HL_SIZE];
-extern const float nnue_output_weights[NUM_BUCKETS][2 * HL_SIZE];
-extern const float nnue_output_bias[NUM_BUCKETS];
+// seen from the perspective, so a1 is always the own queenside corner
+constexpr int KING_BUCKETS[64] = {
+    0, 0, 0, 0, 1, 1, 1, 1,
+    0, 0, 0, 0, 1, 1, 1, 1,
+    2, 2, 2, 2, 3, 3, 3, 3,
+    2, 2, 2, 2, 3, 3, 3, 3,
+    2, 2, 2, 2, 3, 3, 3, 3,
+    2, 2, 2, 2, 3, 3, 3, 3,
+    2, 2, 2, 2, 3, 3, 3, 3,
+    2, 2, 2, 2, 3, 3, 3, 3,
+};
+
+// quantization, accumulator values are scaled by QA and output weights by QB.
+// SCReLU output clamp(x, 0, QA)^2 is shifted right by SCRELU_SHIFT so it fits into an int16
+const int QA = 255;
+const int QB = 256;
+const int SCRELU_SHIFT = 8;
+// one centipawn in units of the summed output layer
+const int32_t OUTPUT_SCALE = (QA * QA * QB) >> SCRELU_SHIFT;
+
+// binary network file: a 64 byte header followed by the QuantizedNetwork exactly as laid out in memory,
+// written by nnue/export_network.py and mapped read-only so every engine process shares the same pages
+constexpr char NNUE_FILE_MAGIC[8] = {'S', 'T', 'L', 'M', 'N', 'N', 'U', 'E'};
+const uint32_t NNUE_FILE_VERSION = 2;
+
+struct alignas(64) NetworkFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t input_size, hl_size, num_buckets, num_king_buckets;
+    int32_t qa, qb, screlu_shift;
+};
+
+struct QuantizedNetwork {
+    alignas(64) int16_t accumulator_weights[INPUT_SIZE][HL_SIZE];
+    alignas(64) int16_t accumulator_biases[HL_SIZE];
+    alignas(64) int16_t output_weights[NUM_BUCKETS][2 * HL_SIZE];
+    alignas(64) int32_t output_bias[NUM_BUCKETS];
+};
+
+bool load_nnue(const std::string& path);
+bool nnue_loaded();
+const char* nnue_simd_name();
+// slow evaluation from scratch in floating point using the dequantized weights, only used for testing the integer kernels
+float nnue_reference_eval(const Board& board);
+int32_t nnue_eval(const Board& board);
+
+// number of unrelated positions which are evaluated together by nnue_eval_batch
+const int NNUE_BATCH_SIZE = 64;
+// same results as nnue_eval for every board, but with far better throughput on many positions.
+// Every board must have one king per side and at most 32 pieces
+void nnue_eval_batch(const std::vector<Board>& boards, std::vector<int32_t>& evals);
 
 class Accumulator {
    public:
-    void init();
-    void add(int bb, int square);
-    void remove(int bb, int square);
+    void refresh(Side perspective, const U64* boards);
+    void update(const Accumulator& parent, Side perspective, int kingSquare, const BoardEditRecorder& recorder);
     int32_t forward(Side side, U64 occupied) const;
 
    private:
-    float white_acc[HL_SIZE];
-    float black_acc[HL_SIZE];
+    // indexed by perspective
+    alignas(64) int16_t values[2][HL_SIZE];
+
+    friend class RefreshCache;
+};
+
+struct RefreshCacheEntry {
+    alignas(64) int16_t values[HL_SIZE];
+    U64 boards[12];  // pieces which are currently added to values
+};
+
+/**
+ * Finny table, keeps one accumulator per perspective and king bucket. After the king
+ * changes bucket only the pieces which differ from the last visit of that bucket are applied.
+ */
+class RefreshCache {
+   public:
+    void init();
+    void refresh(Accumulator& acc, Side perspective, const U64* boards);
+
+   private:
+    RefreshCacheEntry entries[2][NUM_KING_BUCKETS];
 };
 
 struct AccumulatorStackNode {
     Accumulator acc;
+    U64 boards[12];              // pieces of this position, needed for refreshing
     BoardEditRecorder recorder;  // holds edits regarding this board relative to the above one
-    bool dirty;                  // if true, accumulator is valid, otherwise apply recorded edits to parent board
+    bool boardsDirty;            // if true, boards still have to be derived from the parent and the recorded edits
+    bool dirty[2];               // per perspective, if false the accumulator half is valid, otherwise it is derived on demand
 };
 
+/**
+ * Accumulators of the search line, a ply is only computed when it is evaluated. The evaluation needs
+ * both perspectives, so the per perspective dirty flags do not skip work at evaluated nodes. They only
+ * let each perspective start from a different ply: when one king changes bucket, that perspective
+ * refreshes from the cache while the other keeps updating incrementally from its last computed ply.
+ */
 class AccumulatorStack {
    public:
     void init(const Board& board);
@@ -46,6 +120,9 @@ class AccumulatorStack {
 
    private:
     AccumulatorStackNode stack[ACCUMULATOR_MAX_DEPTH];
+    RefreshCache refreshCache;
 
-    void stackUp(int ply);
-};
\ No newline at end of file
+    void syncBoards(int ply);
+    bool kingBucketChanged(int ply, Side perspective) const;
+    void materialize(int ply, Side perspective);
+};
@@ -0,0 +1,232 @@
+#include "nnue_kernels.h"
+
+#include "nnue.h"
+
+// the Makefile compiles this file once per instruction set, each time under another table name
+#ifndef NNUE_KERNELS_TABLE
+#error "compile with -DNNUE_KERNELS_TABLE=<table name>"
+#endif
+
+#if defined(__AVX512BW__) || defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+// same kernels for every instruction set, only the vector width changes. The -march of this object decides which one
+#if defined(__AVX512BW__)
+typedef __m512i vec_t;
+#define SIMD_NAME "avx512"
+#define vec_load(a) _mm512_load_si512((const void*)(a))
+#define vec_store(a, b) _mm512_store_si512((void*)(a), b)
+#define vec_add_epi16 _mm512_add_epi16
+#define vec_sub_epi16 _mm512_sub_epi16
+#define vec_max_epi16 _mm512_max_epi16
+#define vec_min_epi16 _mm512_min_epi16
+#define vec_madd_epi16 _mm512_madd_epi16
+#define vec_add_epi32 _mm512_add_epi32
+#define vec_set1_epi16 _mm512_set1_epi16
+#define vec_zero _mm512_setzero_si512
+#define vec_slli_epi16 _mm512_slli_epi16
+#define vec_mulhrs_epi16 _mm512_mulhrs_epi16
+// maskz variants because the plain extract trips -Wuninitialized in some gcc versions
+static inline int32_t vec_reduce_add_epi32(__m512i v) {
+    __m256i half = _mm256_add_epi32(_mm512_maskz_extracti64x4_epi64(0xFF, v, 0), _mm512_maskz_extracti64x4_epi64(0xFF, v, 1));
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(half), _mm256_extracti128_si256(half, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+}
+#elif defined(__AVX2__)
+typedef __m256i vec_t;
+#define SIMD_NAME "avx2"
+#define vec_load(a) _mm256_load_si256((const __m256i*)(a))
+#define vec_store(a, b) _mm256_store_si256((__m256i*)(a), b)
+#define vec_add_epi16 _mm256_add_epi16
+#define vec_sub_epi16 _mm256_sub_epi16
+#define vec_max_epi16 _mm256_max_epi16
+#define vec_min_epi16 _mm256_min_epi16
+#define vec_madd_epi16 _mm256_madd_epi16
+#define vec_add_epi32 _mm256_add_epi32
+#define vec_set1_epi16 _mm256_set1_epi16
+#define vec_zero _mm256_setzero_si256
+#define vec_slli_epi16 _mm256_slli_epi16
+#define vec_mulhrs_epi16 _mm256_mulhrs_epi16
+static inline int32_t vec_reduce_add_epi32(__m256i v) {
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+}
+#elif defined(__SSE4_1__)
+typedef __m128i vec_t;
+#define SIMD_NAME "sse4.1"
+#define vec_load(a) _mm_load_si128((const __m128i*)(a))
+#define vec_store(a, b) _mm_store_si128((__m128i*)(a), b)
+#define vec_add_epi16 _mm_add_epi16
+#define vec_sub_epi16 _mm_sub_epi16
+#define vec_max_epi16 _mm_max_epi16
+#define vec_min_epi16 _mm_min_epi16
+#define vec_madd_epi16 _mm_madd_epi16
+#define vec_add_epi32 _mm_add_epi32
+#define vec_set1_epi16 _mm_set1_epi16
+#define vec_zero _mm_setzero_si128
+#define vec_slli_epi16 _mm_slli_epi16
+#define vec_mulhrs_epi16 _mm_mulhrs_epi16
+static inline int32_t vec_reduce_add_epi32(__m128i v) {
+    __m128i sum = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+}
+#else
+#define SIMD_NAME "scalar"
+#endif
+
+#ifdef vec_load
+const int VEC_SIZE = sizeof(vec_t) / sizeof(int16_t);
+static_assert(HL_SIZE % VEC_SIZE == 0);
+#endif
+
+// everything but the table has internal linkage, otherwise the linker could merge the copies built for different instruction sets
+namespace {
+
+#ifndef vec_load
+int32_t clamp_qa(int32_t x) {
+    return x < 0 ? 0 : (x > QA ? QA : x);
+}
+#endif
+
+void add_weights(int16_t* acc, const int16_t* weights) {
+#ifdef vec_load
+    for (int i = 0; i < HL_SIZE; i += VEC_SIZE) {
+        vec_store(acc + i, vec_add_epi16(vec_load(acc + i), vec_load(weights + i)));
+    }
+#else
+    for (int i = 0; i < HL_SIZE; i++) {
+        acc[i] += weights[i];
+    }
+#endif
+}
+
+// in plus the added minus the subtracted weight rows. The counts are fixed at compile time for the common
+// edits so the loops unroll, the defaults take them from the arguments instead
+template <int NumAdds = -1, int NumSubs = -1>
+void apply_edits(int16_t* out, const int16_t* in, const int16_t* const* adds, int numAdds, const int16_t* const* subs, int numSubs) {
+    if constexpr (NumAdds >= 0) numAdds = NumAdds;
+    if constexpr (NumSubs >= 0) numSubs = NumSubs;
+#ifdef vec_load
+    for (int i = 0; i < HL_SIZE; i += VEC_SIZE) {
+        vec_t v = vec_load(in + i);
+        for (int a = 0; a < numAdds; a++) {
+            v = vec_add_epi16(v, vec_load(adds[a] + i));
+        }
+        for (int s = 0; s < numSubs; s++) {
+            v = vec_sub_epi16(v, vec_load(subs[s] + i));
+        }
+        vec_store(out + i, v);
+    }
+#else
+    for (int i = 0; i < HL_SIZE; i++) {
+        int16_t v = in[i];
+        for (int a = 0; a < numAdds; a++) {
+            v += adds[a][i];
+        }
+        for (int s = 0; s < numSubs; s++) {
+            v -= subs[s][i];
+        }
+        out[i] = v;
+    }
+#endif
+}
+
+void update_weights(int16_t* out, const int16_t* in, const int16_t* const* adds, int numAdds, const int16_t* const* subs, int numSubs) {
+    if (numAdds == 1 && numSubs == 1) {
+        apply_edits<1, 1>(out, in, adds, numAdds, subs, numSubs);  // quiet move
+    } else if (numAdds == 1 && numSubs == 2) {
+        apply_edits<1, 2>(out, in, adds, numAdds, subs, numSubs);  // capture
+    } else if (numAdds == 2 && numSubs == 2) {
+        apply_edits<2, 2>(out, in, adds, numAdds, subs, numSubs);  // castling
+    } else {
+        // promotions, or whatever else a move records
+        apply_edits(out, in, adds, numAdds, subs, numSubs);
+    }
+}
+
+int32_t screlu_dot(const int16_t* acc, const int16_t* weights) {
+#ifdef vec_load
+    const vec_t zero = vec_zero();
+    const vec_t qa = vec_set1_epi16(QA);
+    vec_t sum = vec_zero();
+    for (int i = 0; i < HL_SIZE; i += VEC_SIZE) {
+        vec_t clamped = vec_min_epi16(vec_max_epi16(vec_load(acc + i), zero), qa);
+        // mulhrs computes (a * b + 2^14) >> 15, so shifting one factor by 15 - SCRELU_SHIFT yields the rounded square
+        vec_t activated = vec_mulhrs_epi16(vec_slli_epi16(clamped, 15 - SCRELU_SHIFT), clamped);
+        sum = vec_add_epi32(sum, vec_madd_epi16(activated, vec_load(weights + i)));
+    }
+    return vec_reduce_add_epi32(sum);
+#else
+    int32_t sum = 0;
+    for (int i = 0; i < HL_SIZE; i++) {
+        int32_t clamped = clamp_qa(acc[i]);
+        sum += ((clamped * clamped + (1 << (SCRELU_SHIFT - 1))) >> SCRELU_SHIFT) * weights[i];
+    }
+    return sum;
+#endif
+}
+
+void screlu_activate(int16_t* out, const int16_t* acc) {
+#ifdef vec_load
+    const vec_t zero = vec_zero();
+    const vec_t qa = vec_set1_epi16(QA);
+    for (int i = 0; i < HL_SIZE; i += VEC_SIZE) {
+        vec_t clamped = vec_min_epi16(vec_max_epi16(vec_load(acc + i), zero), qa);
+        vec_store(out + i, vec_mulhrs_epi16(vec_slli_epi16(clamped, 15 - SCRELU_SHIFT), clamped));
+    }
+#else
+    for (int i = 0; i < HL_SIZE; i++) {
+        int32_t clamped = clamp_qa(acc[i]);
+        out[i] = (clamped * clamped + (1 << (SCRELU_SHIFT - 1))) >> SCRELU_SHIFT;
+    }
+#endif
+}
+
+// every weight chunk is loaded once for all Tile positions
+template <int Tile>
+void output_tile_fixed(const int16_t* const* activations, const int16_t* weights, int32_t* sums) {
+#ifdef vec_load
+    vec_t acc[Tile];
+    for (int k = 0; k < Tile; k++) {
+        acc[k] = vec_zero();
+    }
+    for (int i = 0; i < 2 * HL_SIZE; i += VEC_SIZE) {
+        vec_t w = vec_load(weights + i);
+        for (int k = 0; k < Tile; k++) {
+            acc[k] = vec_add_epi32(acc[k], vec_madd_epi16(vec_load(activations[k] + i), w));
+        }
+    }
+    for (int k = 0; k < Tile; k++) {
+        sums[k] = vec_reduce_add_epi32(acc[k]);
+    }
+#else
+    for (int k = 0; k < Tile; k++) {
+        sums[k] = 0;
+        for (int i = 0; i < 2 * HL_SIZE; i++) {
+            sums[k] += activations[k][i] * weights[i];
+        }
+    }
+#endif
+}
+
+void output_tile(const int16_t* const* activations, const int16_t* weights, int32_t* sums, int count) {
+    if (count == NNUE_OUTPUT_TILE) {
+        output_tile_fixed<NNUE_OUTPUT_TILE>(activations, weights, sums);
+        return;
+    }
+    for (int k = 0; k < count; k++) {
+        output_tile_fixed<1>(activations + k, weights, sums + k);
+    }
+}
+
+}  // namespace
+
+extern const NnueKernels NNUE_KERNELS_TABLE = {
+    SIMD_NAME, add_weights, update_weights, screlu_dot, screlu_activate, output_tile,
+};
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+
+// the hot loops of the network. nnue_kernels.cpp is compiled once per instruction set (see the Makefile)
+// and the best table the cpu supports is picked at startup, so one binary runs everywhere
+struct NnueKernels {
+    const char* name;
+    void (*add_weights)(int16_t* acc, const int16_t* weights);
+    // out = in + sum(adds) - sum(subs) in one pass, out may be the same as in
+    void (*update_weights)(int16_t* out, const int16_t* in, const int16_t* const* adds, int numAdds, const int16_t* const* subs, int numSubs);
+    // sum of round(clamp(acc, 0, QA)^2 / 2^SCRELU_SHIFT) * weights
+    int32_t (*screlu_dot)(const int16_t* acc, const int16_t* weights);
+    // out = round(clamp(acc, 0, QA)^2 / 2^SCRELU_SHIFT), same activation as screlu_dot
+    void (*screlu_activate)(int16_t* out, const int16_t* acc);
+    // sums[k] = dot(activations[k], weights) over the concatenated layer for count <= NNUE_OUTPUT_TILE positions
+    void (*output_tile)(const int16_t* const* activations, const int16_t* weights, int32_t* sums, int count);
+};
+
+const int NNUE_OUTPUT_TILE = 4;
+
+extern const NnueKernels NNUE_KERNELS_SCALAR;
+extern const NnueKernels NNUE_KERNELS_SSE41;
+extern const NnueKernels NNUE_KERNELS_AVX2;
+extern const NnueKernels NNUE_KERNELS_AVX512;
@@ -246,6 +246,104 @@ void Position::movePseudoInPlace(GenMove move) {
     }
 }
 
+void Position::makeMove(const GenMove& move, UndoRecord& undo) {
+    board.saveUndo(undo.board);
+    undo.fullMovesCount = fullMovesCount;
+    undo.noCaptureOrPush = noCaptureOrPush;
+
+    // find the captured piece now, afterwards it is gone
+    undo.captured = -1;
+    undo.capturedSquare = move.to;
+    if (move.type == MoveTypes::EnpasKing) {
+        undo.capturedSquare = move.from + 1;
+    } else if (move.type == MoveTypes::EnpasQueen) {
+        undo.capturedSquare = move.from - 1;
+    }
+    bool isCastle = move.type == MoveTypes::CastleWhiteKing || move.type == MoveTypes::CastleWhiteQueen ||
+                    move.type == MoveTypes::CastleBlackKing || move.type == MoveTypes::CastleBlackQueen;
+    if (!isCastle) {
+        int offset = board.getSideToMove() == Side::White ? 6 : 0;
+        U64 capturedMask = 1ULL << undo.capturedSquare;
+        for (int bb = offset; bb < offset + 6; bb++) {
+            if (board.getBoard((BitBoards)bb) & capturedMask) {
+                undo.captured = bb;
+                break;
+            }
+        }
+    }
+
+    movePseudoInPlace(move);
+}
+
+void Position::unmakeMove(const GenMove& move, const UndoRecord& undo) {
+    // hash is overwritten at the end, so the piece edits below may change it freely
+    MoveTypes moveType = move.type;
+    if (moveType == MoveTypes::CastleWhiteKing) {
+        board.removePiece(BitBoards::KW, 6);
+        board.placePiece(BitBoards::KW, 4);
+        board.removePiece(BitBoards::RW, 5);
+        board.placePiece(BitBoards::RW, 7);
+    } else if (moveType == MoveTypes::CastleWhiteQueen) {
+        board.removePiece(BitBoards::KW, 2);
+        board.placePiece(BitBoards::KW, 4);
+        board.removePiece(BitBoards::RW, 3);
+        board.placePiece(BitBoards::RW, 0);
+    } else if (moveType == MoveTypes::CastleBlackKing) {
+        board.removePiece(BitBoards::KB, 62);
+        board.placePiece(BitBoards::KB, 60);
+        board.removePiece(BitBoards::RB, 61);
+        board.placePiece(BitBoards::RB, 63);
+    } else if (moveType == MoveTypes::CastleBlackQueen) {
+        board.removePiece(BitBoards::KB, 58);
+        board.placePiece(BitBoards::KB, 60);
+        board.removePiece(BitBoards::RB, 59);
+        board.placePiece(BitBoards::RB, 56);
+    } else {
+        if (moveType == MoveTypes::Promote) {
+            // the promoted piece is whatever now stands on the target square
+            int offset = (int)move.bb < 6 ? 0 : 6;
+            for (int bb = offset; bb < offset + 6; bb++) {
+                if (board.getBoard((BitBoards)bb) & (1ULL << move.to)) {
+                    board.removePiece((BitBoards)bb, move.to);
+                    break;
+                }
+            }
+        } else {
+            board.removePiece(move.bb, move.to);
+        }
+        board.placePiece(move.bb, move.from);
+
+        if (undo.captured >= 0) {
+            board.placePiece((BitBoards)undo.captured, undo.capturedSquare);
+        }
+    }
+
+    board.switchSide();
+    board.restoreUndo(undo.board);
+    fullMovesCount = undo.fullMovesCount;
+    noCaptureOrPush = undo.noCaptureOrPush;
+}
+
+// passes the turn, en passant and the hash are updated like after a real move
+void Position::makeNullMove(UndoRecord& undo) {
+    board.saveUndo(undo.board);
+    undo.fullMovesCount = fullMovesCount;
+    undo.noCaptureOrPush = noCaptureOrPush;
+    undo.captured = -1;
+
+    if (board.getSideToMove() == Side::Black) {
+        fullMovesCount++;
+    }
+    board.passTurn();
+}
+
+void Position::unmakeNullMove(const UndoRecord& undo) {
+    board.switchSide();
+    board.restoreUndo(undo.board);
+    fullMovesCount = undo.fullMovesCount;
+    noCaptureOrPush = undo.noCaptureOrPush;
+}
+
 std::string Position::toFen() const {
     std::string fen = "";
     int emptyCount = 0;
@@ -353,11 +451,11 @@ void Position::print(bool moves) {
     // std::cout << "Eval: " << eval << "\n\n";
 
     if (moves) {
-        MoveList pseudoMoves;
-        board.generatePseudoMoves(pseudoMoves);
+        MoveList legalMoves;
+        board.generateMoves(legalMoves);
 
-        std::cout << "Pseudo moves: (" + std::to_string(pseudoMoves.size) + ")\n";
-        for (GenMove genMove : pseudoMoves) {
+        std::cout << "Legal moves: (" + std::to_string(legalMoves.size) + ")\n";
+        for (GenMove genMove : legalMoves) {
             std::cout << genMove.toString() << std::endl;
         }
         std::cout << "\n";
@@ -365,13 +463,5 @@ void Position::print(bool moves) {
 }
 
 void Position::generateLegalMoves(MoveList& moveList) {
-    MoveList pseudoMoves;
-    board.generatePseudoMoves(pseudoMoves);
-    for (const GenMove& m : pseudoMoves) {
-        Position testPosition = *this;
-        testPosition.movePseudoInPlace(m);
-        if (testPosition.board.isLegal()) {
-            moveList.add(m);
-        }
-    }
+    board.generateMoves(moveList);
 }
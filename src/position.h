@@ -5,6 +5,15 @@
 #include "board.h"
 #include "hash.h"
 
+// everything needed to take back a move made with Position::makeMove
+struct UndoRecord {
+    BoardUndo board;
+    int captured;  // BitBoards of the captured piece, -1 if none
+    int capturedSquare;
+    short fullMovesCount;
+    short noCaptureOrPush;
+};
+
 class Position {
    public:
     Board board;
@@ -20,4 +29,8 @@ class Position {
 
     void generateLegalMoves(MoveList& moveList);
     void movePseudoInPlace(GenMove move);
+    void makeMove(const GenMove& move, UndoRecord& undo);
+    void unmakeMove(const GenMove& move, const UndoRecord& undo);
+    void makeNullMove(UndoRecord& undo);
+    void unmakeNullMove(const UndoRecord& undo);
 };
@@ -0,0 +1,87 @@
+#include "timeman.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+// factor on the soft limit by the number of iterations the best move stayed the same
+constexpr double STABILITY_SCALE[] = {1.6, 1.25, 1.0, 0.9, 0.8};
+const int MAX_STABILITY = 4;
+
+void TimeManager::init(const SearchParams& params, Side side, int moveOverhead) {
+    softLimit = hardLimit = -1;
+    fixedTime = false;
+    completedIterations = 0;
+    lastIterationEnd = lastIterationMillis = 0;
+    lastBestMove = LanMove::NullMove();
+    bestMoveStability = 0;
+    lastScore = 0;
+    scale = 1.0;
+
+    if (params.infinite) {
+        return;
+    }
+
+    // movetime <ms>, the whole time is used and the timer ends the search
+    if (params.movetime > 0) {
+        softLimit = hardLimit = std::max(1L, params.movetime - moveOverhead);
+        fixedTime = true;
+        return;
+    }
+
+    long remainingTime = side == Side::White ? params.wtime : params.btime;
+    long increment = std::max(0L, side == Side::White ? params.winc : params.binc);
+    if (remainingTime <= 0) {
+        return;
+    }
+
+    long movesToGo = params.movestogo > 0 ? std::min(params.movestogo, 50L) : DEFAULT_MOVES_TO_GO;
+    long available = std::max(1L, remainingTime - moveOverhead);
+
+    // the hard limit never risks the clock, even on the last move before the time control
+    hardLimit = std::max(1L, std::min(available * 3 / 4, available / movesToGo * 5 + increment));
+    softLimit = std::min(hardLimit, available / movesToGo + increment * 3 / 4);
+}
+
+long TimeManager::getHardLimit() const {
+    return hardLimit;
+}
+
+void TimeManager::iterationDone(long elapsedMillis, const LanMove& bestMove, Score score, double bestMoveNodeShare) {
+    lastIterationMillis = elapsedMillis - lastIterationEnd;
+    lastIterationEnd = elapsedMillis;
+
+    bool sameBestMove = bestMove.from == lastBestMove.from && bestMove.to == lastBestMove.to &&
+                        bestMove.promotion == lastBestMove.promotion;
+    bestMoveStability = sameBestMove ? std::min(bestMoveStability + 1, MAX_STABILITY) : 0;
+    double stabilityFactor = STABILITY_SCALE[bestMoveStability];
+
+    // a falling score means the search found a problem which deserves a closer look
+    double scoreFactor = 1.0;
+    if (completedIterations > 0 && std::abs(score) < MAX_EVAL && std::abs(lastScore) < MAX_EVAL) {
+        scoreFactor = std::clamp(1.0 + (lastScore - score) / 100.0, 0.9, 1.5);
+    }
+
+    // most nodes on the best move mean the alternatives were refuted quickly
+    double nodeFactor = std::clamp((1.6 - bestMoveNodeShare) * 1.2, 0.5, 2.0);
+
+    scale = stabilityFactor * scoreFactor * nodeFactor;
+    lastBestMove = bestMove;
+    lastScore = score;
+    completedIterations++;
+}
+
+bool TimeManager::canStartIteration(long elapsedMillis) const {
+    if (softLimit < 0 || completedIterations == 0) {
+        // without any result there is nothing to play
+        return true;
+    }
+    if (fixedTime) {
+        // the timer stops the search at the hard limit
+        return true;
+    }
+    if (elapsedMillis >= softLimit * scale) {
+        return false;
+    }
+    // an iteration cut by the hard limit would only waste the time
+    return elapsedMillis + lastIterationMillis * ITERATION_TIME_GROWTH < hardLimit;
+}
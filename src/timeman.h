@@ -0,0 +1,49 @@
+#pragma once
+#include <vector>
+
+#include "eval.h"
+#include "labels.h"
+#include "moves.h"
+
+// limits of a go command, numbers which were not given are -1
+struct SearchParams {
+    long wtime = -1, btime = -1, winc = -1, binc = -1, movestogo = -1;
+    long depth = -1, nodes = -1, mate = -1, movetime = -1;
+    bool infinite = false, ponder = false;
+    std::vector<LanMove> searchmoves;
+};
+
+// milliseconds lost per move between the engine and the clock, e.g. by the gui or network
+const int MOVE_OVERHEAD_DEFAULT = 10;
+// moves the remaining clock is planned for when movestogo is not given
+const int DEFAULT_MOVES_TO_GO = 25;
+// an iteration is assumed to take this many times longer than the one before
+const int ITERATION_TIME_GROWTH = 2;
+
+/**
+ * Plans the time of one move. The hard limit is enforced by the timer and may cut an iteration,
+ * the soft limit is only checked between iterations and scaled by how settled the search looks:
+ * a best move which keeps changing, a falling score or a best move which needed only few of the
+ * root nodes all ask for more time.
+ */
+class TimeManager {
+   public:
+    void init(const SearchParams& params, Side side, int moveOverhead);
+    // -1 if the search is not limited by time
+    long getHardLimit() const;
+    // called by the main thread after each completed iteration
+    void iterationDone(long elapsedMillis, const LanMove& bestMove, Score score, double bestMoveNodeShare);
+    // false if the next iteration would run past the soft limit or could not finish before the hard limit,
+    // always true for a fixed movetime
+    bool canStartIteration(long elapsedMillis) const;
+
+   private:
+    long softLimit = -1, hardLimit = -1;
+    bool fixedTime = false;  // go movetime, only the hard limit applies
+    int completedIterations = 0;
+    long lastIterationEnd = 0, lastIterationMillis = 0;
+    LanMove lastBestMove;
+    int bestMoveStability = 0;
+    Score lastScore = 0;
+    double scale = 1.0;
+};
@@ -0,0 +1,126 @@
+#include "tt.h"
+
+#include <cstring>
+
+const int AGE_CYCLE = 64;
+
+LanMove TTEntry::getMove() const {
+    return LanMove(move & 0x3F, (move >> 6) & 0x3F, (MovePromotions)(move >> 12));
+}
+
+uint16_t packMove(const LanMove& move) {
+    return move.from | move.to << 6 | (int)move.promotion << 12;
+}
+
+TTEntry loadEntry(const std::atomic<uint64_t>& word) {
+    uint64_t data = word.load(std::memory_order_relaxed);
+    TTEntry entry;
+    std::memcpy(&entry, &data, sizeof(entry));
+    return entry;
+}
+
+void storeEntry(std::atomic<uint64_t>& word, const TTEntry& entry) {
+    uint64_t data;
+    std::memcpy(&data, &entry, sizeof(entry));
+    word.store(data, std::memory_order_relaxed);
+}
+
+TranspositionTable::TranspositionTable() {
+    age = 0;
+    resize(TT_DEFAULT_MB);
+}
+
+void TranspositionTable::resize(size_t megabytes) {
+    // round down to a power of two so the index is a mask of the hash
+    size_t count = 1;
+    while (2 * count * sizeof(TTCluster) <= megabytes * 1024 * 1024) {
+        count *= 2;
+    }
+    clusters.reset(new TTCluster[count]);
+    mask = count - 1;
+    clear();
+}
+
+void TranspositionTable::clear() {
+    for (size_t i = 0; i <= mask; i++) {
+        for (std::atomic<uint64_t>& word : clusters[i].entries) {
+            word.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void TranspositionTable::newSearch() {
+    age = (age + 1) % AGE_CYCLE;
+}
+
+bool TranspositionTable::probe(U64 hash, TTEntry& entry) const {
+    const TTCluster& cluster = clusters[hash & mask];
+    uint16_t key = hash >> 48;
+    for (const std::atomic<uint64_t>& word : cluster.entries) {
+        TTEntry e = loadEntry(word);
+        if (e.key == key && e.getBound() != Bound::None) {
+            entry = e;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TranspositionTable::store(U64 hash, LanMove move, Score score, int depth, Bound bound) {
+    TTCluster& cluster = clusters[hash & mask];
+    uint16_t key = hash >> 48;
+
+    std::atomic<uint64_t>* replaceWord = &cluster.entries[0];
+    TTEntry replace = loadEntry(*replaceWord);
+    int worstValue = 1 << 30;
+    for (std::atomic<uint64_t>& word : cluster.entries) {
+        TTEntry e = loadEntry(word);
+        if (e.key == key || e.getBound() == Bound::None) {
+            replaceWord = &word;
+            replace = e;
+            break;
+        }
+        // every search generation an entry is older makes it worth as much as 8 plies less
+        int relativeAge = (AGE_CYCLE + age - e.getAge()) % AGE_CYCLE;
+        int value = e.depth - 8 * relativeAge;
+        if (value < worstValue) {
+            worstValue = value;
+            replaceWord = &word;
+            replace = e;
+        }
+    }
+
+    bool sameKey = replace.key == key && replace.getBound() != Bound::None;
+    // keep a deeper result of this search unless the new one is exact
+    if (sameKey && bound != Bound::Exact && replace.getAge() == age && depth + 3 < replace.depth) {
+        return;
+    }
+    if (!sameKey || !move.isNullMove()) {
+        replace.move = packMove(move);
+    }
+    replace.key = key;
+    replace.score = score;
+    replace.depth = depth;
+    replace.ageBound = age << 2 | (uint8_t)bound;
+    storeEntry(*replaceWord, replace);
+}
+
+Score scoreToTT(Score score, int ply) {
+    if (score > MAX_EVAL) {
+        return score + ply;
+    }
+    if (score < -MAX_EVAL) {
+        return score - ply;
+    }
+    return score;
+}
+
+Score scoreFromTT(Score score, int ply) {
+    if (score > MAX_EVAL) {
+        return score - ply;
+    }
+    if (score < -MAX_EVAL) {
+        return score + ply;
+    }
+    return score;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "eval.h"
+#include "labels.h"
+#include "moves.h"
+
+const int TT_DEFAULT_MB = 16;
+
+enum class Bound : uint8_t {
+    None,
+    Exact,
+    Lower,  // score is at least this value (fail high)
+    Upper,  // score is at most this value (fail low)
+};
+
+// 8 bytes, stored as one atomic word so threads sharing the table never see a half written entry
+struct TTEntry {
+    uint16_t key;       // upper 16 bits of the hash, the lower bits are implied by the cluster index
+    uint16_t move;      // from | to << 6 | promotion << 12
+    int16_t score;      // mate scores relative to the node, see scoreToTT
+    uint8_t depth;      // remaining depth of the search which produced this entry
+    uint8_t ageBound;   // search generation in the upper 6 bits, bound in the lower 2
+
+    LanMove getMove() const;
+    Bound getBound() const { return (Bound)(ageBound & 0x3); }
+    uint8_t getAge() const { return ageBound >> 2; }
+};
+
+static_assert(sizeof(TTEntry) == sizeof(uint64_t), "an entry must fit into one atomic word");
+
+// four entries make a 32 byte cluster so two clusters share a cache line
+const int TT_CLUSTER_SIZE = 4;
+
+struct alignas(32) TTCluster {
+    std::atomic<uint64_t> entries[TT_CLUSTER_SIZE];
+};
+
+static_assert(sizeof(TTCluster) == 32, "a cluster must fill exactly half a cache line");
+
+/**
+ * Preallocated hash table for search results, shared by all search threads without locking. Positions map to a cluster by the lower hash
+ * bits, inside the cluster the entry is found by the upper 16 bits. When a cluster is full
+ * the entry with the least depth is replaced, where entries from older searches count as shallower.
+ */
+class TranspositionTable {
+   public:
+    TranspositionTable();
+    void resize(size_t megabytes);
+    void clear();
+    void newSearch();
+    bool probe(U64 hash, TTEntry& entry) const;
+    void store(U64 hash, LanMove move, Score score, int depth, Bound bound);
+
+   private:
+    std::unique_ptr<TTCluster[]> clusters;
+    size_t mask;
+    uint8_t age;
+};
+
+// mate scores are stored relative to the node instead of the root so they stay valid at any ply
+Score scoreToTT(Score score, int ply);
+Score scoreFromTT(Score score, int ply);
@@ -1,21 +1,35 @@
 #include "uci.h"
 
 #include <array>
+#include <chrono>
+#include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <iostream>
 #include <optional>
-#include <set>
 #include <thread>
 
+#include "attacks.h"
+#include "bitmath.h"
 #include "history.h"
 #include "log.h"
 #include "moves.h"
+#include "nnue.h"
 #include "position.h"
 
-std::set<const char*, StringComparator> allLongParams = {
-    "wtime", "btime", "winc", "binc", "movestogo", "depth", "nodes", "mate", "movetime"};
-std::set<const char*, StringComparator> allBoolParams = {
-    "infinite", "ponder"};
+// field of a go parameter followed by a number, nullptr if there is none with this name
+long* findLongParam(SearchParams& params, const std::string& name) {
+    if (name == "wtime") return &params.wtime;
+    if (name == "btime") return &params.btime;
+    if (name == "winc") return &params.winc;
+    if (name == "binc") return &params.binc;
+    if (name == "movestogo") return &params.movestogo;
+    if (name == "depth") return &params.depth;
+    if (name == "nodes") return &params.nodes;
+    if (name == "mate") return &params.mate;
+    if (name == "movetime") return &params.movetime;
+    return nullptr;
+}
 
 const std::string ENGINE_NAME = "Stalemater2000";
 
@@ -44,9 +58,12 @@ std::optional<int> nextInteger(std::list<std::string>& keywords, const std::stri
     return std::nullopt;
 }
 
-UCI::UCI() {
+UCI::UCI(const std::string& defaultEvalFile) : defaultEvalFile(defaultEvalFile) {
     std::cout << ENGINE_NAME << std::endl;
     hist = History();
+    if (!load_nnue(defaultEvalFile)) {
+        std::cout << "info string no network loaded, using static evaluation" << std::endl;
+    }
 }
 
 void tokenize(std::string const& str, const char delim, std::list<std::string>& out) {
@@ -77,6 +94,8 @@ void UCI::writeTokenizedCommand(std::string rawLine) {
         handleUci(tokenizedLine);
     else if (firstToken == "isready")
         handleIsReady(tokenizedLine);
+    else if (firstToken == "setoption")
+        handleSetOption(tokenizedLine);
     else if (firstToken == "go")
         handleGo(tokenizedLine);
     else if (firstToken == "position")
@@ -89,6 +108,10 @@ void UCI::writeTokenizedCommand(std::string rawLine) {
         handleQuit(tokenizedLine);
     else if (firstToken == "movelist")
         handleMovelist(tokenizedLine);
+    else if (firstToken == "eval")
+        handleEval(tokenizedLine);
+    else if (firstToken == "evalbatch")
+        handleEvalBatch(tokenizedLine);
     else {
         printf("ERROR unknown command entered \"%s\"\n", firstToken.c_str());
     }
@@ -116,6 +139,11 @@ void UCI::consumeOutput() {
     }
     computer.infoBuffer.clear();
 
+    for (const std::string& infoString : computer.infoStrings) {
+        printf("info string %s\n", infoString.c_str());
+    }
+    computer.infoStrings.clear();
+
     if (computer.bestMove != NULL) {
         printf("bestmove %s\n", computer.bestMove->toString().c_str());
         computer.bestMove.reset();
@@ -124,8 +152,19 @@ void UCI::consumeOutput() {
 
 void UCI::handleUci(std::list<std::string>& params) {
     (void)params;
-    std::cout << "id name " << ENGINE_NAME << std::endl;
+    std::cout << "id name " << ENGINE_NAME << " " << nnue_simd_name() << std::endl;
     std::cout << "id author dogefromage" << std::endl;
+    std::cout << "option name EvalFile type string default " << defaultEvalFile << std::endl;
+    std::cout << "option name Threads type spin default 1 min 1 max 256" << std::endl;
+    std::cout << "option name Move Overhead type spin default " << MOVE_OVERHEAD_DEFAULT << " min 0 max 5000" << std::endl;
+    std::cout << "option name Hash type spin default " << TT_DEFAULT_MB << " min 1 max 4096" << std::endl;
+    std::cout << "option name Clear Hash type button" << std::endl;
+    std::cout << "option name EvalCache type spin default " << EVAL_CACHE_DEFAULT_MB << " min 1 max 4096" << std::endl;
+    std::cout << "option name NullMove type check default true" << std::endl;
+    std::cout << "option name ReverseFutility type check default true" << std::endl;
+    std::cout << "option name Futility type check default true" << std::endl;
+    std::cout << "option name LateMoveReductions type check default true" << std::endl;
+    std::cout << "option name DeltaPruning type check default true" << std::endl;
     std::cout << "uciok" << std::endl;
 }
 
@@ -134,12 +173,95 @@ void UCI::handleIsReady(std::list<std::string>& params) {
     std::cout << "readyok" << std::endl;
 }
 
+void UCI::handleSetOption(std::list<std::string>& params) {
+    std::optional<std::string> nameKeyword = nextKeyword(params, "name");
+    if (!nameKeyword.has_value() || nameKeyword.value() != "name") {
+        printf("ERROR expected [name]\n");
+        return;
+    }
+    // option names and values may contain spaces
+    std::string name, value;
+    while (!params.empty() && params.front() != "value") {
+        name += (name.empty() ? "" : " ") + params.front();
+        params.pop_front();
+    }
+    if (!params.empty()) {
+        params.pop_front();
+    }
+    while (!params.empty()) {
+        value += (value.empty() ? "" : " ") + params.front();
+        params.pop_front();
+    }
+
+    if (computer.isWorking) {
+        printf("ERROR cannot change options while computer is working\n");
+        return;
+    }
+    // a stopped search may still be returning, its threads use the tables and workers changed below
+    computer.waitForSearch();
+
+    if (name == "EvalFile") {
+        if (load_nnue(value)) {
+            std::cout << "info string loaded network " << value << std::endl;
+            // cached scores belong to the previous network
+            computer.evalCache.clear();
+        }
+    } else if (name == "Threads") {
+        int threads = std::atoi(value.c_str());
+        if (threads < 1 || threads > 256) {
+            printf("ERROR Threads must be between 1 and 256\n");
+            return;
+        }
+        computer.setThreads(threads);
+    } else if (name == "Move Overhead") {
+        int overhead = std::atoi(value.c_str());
+        if (overhead < 0 || overhead > 5000) {
+            printf("ERROR Move Overhead must be between 0 and 5000 ms\n");
+            return;
+        }
+        computer.moveOverhead = overhead;
+    } else if (name == "NullMove" || name == "ReverseFutility" || name == "Futility" || name == "LateMoveReductions" ||
+               name == "DeltaPruning") {
+        if (value != "true" && value != "false") {
+            printf("ERROR %s must be true or false\n", name.c_str());
+            return;
+        }
+        bool enabled = value == "true";
+        if (name == "NullMove") computer.options.nullMove = enabled;
+        if (name == "ReverseFutility") computer.options.reverseFutility = enabled;
+        if (name == "Futility") computer.options.futility = enabled;
+        if (name == "LateMoveReductions") computer.options.lateMoveReductions = enabled;
+        if (name == "DeltaPruning") computer.options.deltaPruning = enabled;
+    } else if (name == "Hash") {
+        int megabytes = std::atoi(value.c_str());
+        if (megabytes < 1 || megabytes > 4096) {
+            printf("ERROR Hash must be between 1 and 4096 MB\n");
+            return;
+        }
+        computer.transpositionTable.resize(megabytes);
+    } else if (name == "Clear Hash") {
+        computer.transpositionTable.clear();
+    } else if (name == "EvalCache") {
+        int megabytes = std::atoi(value.c_str());
+        if (megabytes < 1 || megabytes > 4096) {
+            printf("ERROR EvalCache must be between 1 and 4096 MB\n");
+            return;
+        }
+        computer.evalCache.resize(megabytes);
+    } else {
+        printf("ERROR unknown option \"%s\"\n", name.c_str());
+    }
+}
+
 void UCI::handleUciNewGame(std::list<std::string>& params) {
     (void)params;
 
     if (computer.isWorking) {
         computer.stopWorking();
     }
+    computer.waitForSearch();
+    // results of the last game belong to unrelated positions
+    computer.transpositionTable.clear();
 }
 
 void UCI::handleGo(std::list<std::string>& params) {
@@ -170,35 +292,27 @@ void UCI::handleGo(std::list<std::string>& params) {
     // NORMAL SEARCH
     // https://www.wbec-ridderkerk.nl/html/UCIProtocol.html
     ComputerSearchTask newTask(hist.current());
-    newTask.params.attributes = {
-        {"wtime", -1},
-        {"btime", -1},
-        {"winc", -1},
-        {"binc", -1},
-        {"movestogo", -1},
-        {"depth", -1},
-        {"nodes", -1},
-        {"mate", -1},
-        {"movetime", -1},
-        {"infinite", 0},
-        {"ponder", 0},
-    };
+    newTask.gameKeys = hist.getKeys();
 
     while (!params.empty()) {
         std::string param = nextKeyword(params, "search parameter").value();
-        const char* paramStr = param.c_str();
 
-        if (allLongParams.find(paramStr) != allLongParams.end()) {
+        long* longParam = findLongParam(newTask.params, param);
+        if (longParam) {
             std::optional<int> optInt = nextInteger(params, param + " value");
             if (!optInt.has_value()) {
                 continue;
             }
-            newTask.params.attributes[paramStr] = optInt.value();
+            *longParam = optInt.value();
             continue;
         }
 
-        if (allBoolParams.find(paramStr) != allBoolParams.end()) {
-            newTask.params.attributes[paramStr] = 1;
+        if (param == "infinite") {
+            newTask.params.infinite = true;
+            continue;
+        }
+        if (param == "ponder") {
+            newTask.params.ponder = true;
             continue;
         }
 
@@ -219,8 +333,14 @@ void UCI::handleGo(std::list<std::string>& params) {
         printf("ERROR invalid param \"%s\"\n", param.c_str());
     }
 
+    // the task of a stopped search is read until it returns
+    computer.waitForSearch();
     computer.task = newTask;
-    std::thread searchThread(&Computer::launchSearch, &computer);
+    computer.runningSearches++;
+    std::thread searchThread([] {
+        computer.launchSearch();
+        computer.searchReturned();
+    });
     searchThread.detach();
 }
 
@@ -291,6 +411,11 @@ void UCI::handleStop(std::list<std::string>& params) {
 
 void UCI::handleQuit(std::list<std::string>& params) {
     (void)params;
+    // the search threads use the computer, which is destroyed on exit
+    if (computer.isWorking) {
+        computer.stopWorking();
+    }
+    computer.waitForSearch();
     exit(EXIT_SUCCESS);
 }
 
@@ -306,5 +431,117 @@ void UCI::handleMovelist(std::list<std::string>& params) {
     }
 }
 
+void UCI::handleEval(std::list<std::string>& params) {
+    (void)params;
+    if (!nnue_loaded()) {
+        printf("ERROR no network loaded\n");
+        return;
+    }
+    const Board& board = hist.current().board;
+
+    // both relative to side to move
+    int32_t quantized = nnue_eval(board);
+    float reference = nnue_reference_eval(board);
+
+    std::cout << "NNUE kernels: " << nnue_simd_name() << std::endl;
+    std::cout << "Slider attacks: " << sliderAttacksName() << std::endl;
+    std::cout << "NNUE eval (quantized): " << quantized << std::endl;
+    std::cout << "NNUE eval (float): " << reference << std::endl;
+}
+
+void UCI::handleEvalBatch(std::list<std::string>& params) {
+    std::optional<std::string> path = nextKeyword(params, "file");
+    if (!path.has_value()) return;
+    if (!nnue_loaded()) {
+        printf("ERROR no network loaded\n");
+        return;
+    }
+    std::ifstream file(path.value());
+    if (!file) {
+        printf("ERROR could not open \"%s\"\n", path.value().c_str());
+        return;
+    }
+
+    // one fen or epd per line, streamed in chunks so huge files do not have to fit into memory
+    const size_t chunkSize = 64 * NNUE_BATCH_SIZE;
+    std::vector<std::string> fens;
+    std::vector<Board> boards;
+    std::vector<int32_t> evals;
+    long total = 0, lineNumber = 0, skipped = 0;
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    auto evaluateChunk = [&]() {
+        nnue_eval_batch(boards, evals);
+        for (size_t i = 0; i < boards.size(); i++) {
+            // relative to white like the search scores
+            int32_t eval = boards[i].getSideToMove() == Side::White ? evals[i] : -evals[i];
+            std::cout << fens[i] << ": " << eval << "\n";
+        }
+        total += boards.size();
+        fens.clear();
+        boards.clear();
+    };
+    // a bad line must not end a run over millions of positions, it is reported with its number and skipped
+    auto skipLine = [&](const char* reason) {
+        std::cout << "ERROR line " << lineNumber << ": " << reason << "\n";
+        skipped++;
+    };
+
+    std::string line;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        std::list<std::string> tokens;
+        tokenize(line, ' ', tokens);
+        if (tokens.empty()) {
+            continue;
+        }
+
+        // pieces, side, castling and en passant, followed by the clocks of a fen or the opcodes of an epd
+        std::vector<std::string> fenTokens(tokens.begin(), tokens.end());
+        if (fenTokens.size() < 4 || (fenTokens[1] != "w" && fenTokens[1] != "b")) {
+            skipLine("not a fen or epd position");
+            continue;
+        }
+        size_t fields = 4;
+        while (fields < 6 && fields < fenTokens.size() && !fenTokens[fields].empty() &&
+               fenTokens[fields].find_first_not_of("0123456789") == std::string::npos) {
+            fields++;
+        }
+        fenTokens.resize(fields);
+
+        Board board;
+        try {
+            board = Position::fromFen(fenTokens).board;
+        } catch (const std::exception& _) {
+            skipLine("invalid fen");
+            continue;
+        }
+        // the network needs both kings and has room for at most 32 pieces
+        if (countBits(board.getBoard(BitBoards::KW)) != 1 || countBits(board.getBoard(BitBoards::KB)) != 1) {
+            skipLine("each side needs exactly one king");
+            continue;
+        }
+        if (countBits(board.getOccupied()) > 32) {
+            skipLine("more than 32 pieces");
+            continue;
+        }
+
+        std::string fen = fenTokens[0];
+        for (size_t i = 1; i < fenTokens.size(); i++) {
+            fen += " " + fenTokens[i];
+        }
+        boards.push_back(board);
+        fens.push_back(fen);
+        if (boards.size() == chunkSize) {
+            evaluateChunk();
+        }
+    }
+    evaluateChunk();
+
+    auto curr = std::chrono::high_resolution_clock::now();
+    long millis = std::chrono::duration_cast<std::chrono::milliseconds>(curr - startTime).count();
+    std::cout << "Total: " << total << " positions in " << millis << " ms, " << skipped << " lines skipped" << std::endl;
+}
+
 constexpr auto TERMINAL_RESET = "\033[0m";
 constexpr auto TERMINAL_RED = "\033[31m";
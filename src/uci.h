@@ -7,16 +7,18 @@
 
 class UCI {
    public:
-    UCI();
+    UCI(const std::string& defaultEvalFile);
     void writeTokenizedCommand(std::string line);
     void consumeOutput();
 
    private:
     History hist;
+    std::string defaultEvalFile;
 
     // https://www.wbec-ridderkerk.nl/html/UCIProtocol.html
     void handleUci(std::list<std::string>& params);
     void handleIsReady(std::list<std::string>& params);
+    void handleSetOption(std::list<std::string>& params);
     void handleUciNewGame(std::list<std::string>& params);
     void handleGo(std::list<std::string>& params);
     void handlePosition(std::list<std::string>& params);
@@ -24,4 +26,6 @@ class UCI {
     void handleStop(std::list<std::string>& params);
     void handleQuit(std::list<std::string>& params);
     void handleMovelist(std::list<std::string>& params);
+    void handleEval(std::list<std::string>& params);
+    void handleEvalBatch(std::list<std::string>& params);
 };
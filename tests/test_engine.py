@@ -1,3 +1,8 @@
+import os
+import re
+import subprocess
+import time
+
 import pytest
 import chess.engine
 from omegaconf import OmegaConf
@@ -23,3 +28,68 @@ def test_engine_position_evaluation(engine):
         board = chess.Board(fen)
         result = engine.play(board, chess.engine.Limit(time=config.test_positions.limit))
         assert result.move is not None, f"Engine failed to return a move for position {fen}"
+
+def run_commands(commands):
+    process = subprocess.run([config.path_executable], input="\n".join(commands + ["quit"]) + "\n",
+                             capture_output=True, text=True, timeout=60)
+    return process.stdout
+
+def require_network():
+    if "no network loaded" in run_commands([]):
+        pytest.skip("no network loaded, the engine ships without weights")
+
+def test_nnue_quantized_parity(tmp_path):
+    require_network()
+    tolerance = config.nnue_parity
+    if not os.path.exists(tolerance.reference):
+        pytest.skip(f"no float evaluations at {tolerance.reference}, they are written by nnue/export_network.py")
+    references = {}
+    with open(tolerance.reference) as f:
+        for line in f:
+            fen, value = line.rstrip("\n").rsplit(": ", 1)
+            references[fen] = float(value)
+    path = tmp_path / "positions.epd"
+    path.write_text("\n".join(references) + "\n")
+    output = run_commands([f"evalbatch {path}"])
+    for fen, reference in references.items():
+        quantized = int(re.search(re.escape(fen) + r": (-?\d+)", output).group(1))
+        allowed = max(tolerance.absolute, tolerance.relative * abs(reference))
+        assert abs(quantized - reference) <= allowed, f"Quantized eval {quantized} differs from trained network eval {reference} for position {fen}"
+
+def test_nnue_batch_matches_single(tmp_path):
+    require_network()
+    fens = config.test_positions.positions
+    invalid = config.evalbatch_invalid_lines
+    path = tmp_path / "positions.epd"
+    # every valid position is followed by a line which must be skipped
+    lines = [line for pair in zip(fens, invalid * len(fens)) for line in pair]
+    path.write_text("\n".join(lines) + "\n")
+    output = run_commands([f"evalbatch {path}", "isready"])
+    assert "readyok" in output, "Engine did not survive evalbatch with invalid lines"
+    for number in range(2, 2 * len(fens) + 1, 2):
+        assert f"ERROR line {number}:" in output, f"Invalid line {number} was not reported"
+    for fen in fens:
+        single = run_commands([f"position fen {fen}", "eval"])
+        expected = int(re.search(r"NNUE eval \(quantized\): (-?\d+)", single).group(1))
+        if fen.split(" ")[1] == "b":
+            expected = -expected
+        batched = int(re.search(re.escape(fen) + r": (-?\d+)", output).group(1))
+        assert batched == expected, f"Batched eval {batched} differs from single eval {expected} for position {fen}"
+
+def test_nnue_batch_reads_epd(tmp_path):
+    require_network()
+    positions = [" ".join(fen.split(" ")[:4]) for fen in config.test_positions.positions]
+    path = tmp_path / "positions.epd"
+    path.write_text("".join(f'{position} bm e4; id "test";\n' for position in positions))
+    output = run_commands([f"evalbatch {path}"])
+    assert f"Total: {len(positions)} positions" in output, "Not every epd line was evaluated"
+    for position in positions:
+        assert re.search(re.escape(position) + r": -?\d+", output), f"No eval for epd position {position}"
+
+def test_movetime_uses_full_budget(engine):
+    budget = config.movetime
+    start = time.monotonic()
+    result = engine.play(chess.Board(), chess.engine.Limit(time=budget.millis / 1000))
+    elapsed = (time.monotonic() - start) * 1000
+    assert result.move is not None, "Engine failed to return a move for go movetime"
+    assert elapsed >= budget.fraction * budget.millis, f"go movetime {budget.millis} only searched for {elapsed:.0f} ms"